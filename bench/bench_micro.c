@@ -0,0 +1,470 @@
+/*
+ * DMR Voice Relay Server - Microbenchmarks
+ * 
+ * This file times the hot kernels of the packet path in isolation, against
+ * the real client registry, talkgroup routes and timer wheel, with no
+ * sockets in the loop:
+ * 
+ *   parse      header parse and classification of a received datagram
+ *   lookup     the read-locked part of dmr_process_frame(): sender lookup,
+ *              destination ID check and subscription refresh
+ *   group      the fan-out build of dmr_relay_frame() for a group call
+ *   broadcast  the same for broadcast routing, one message per client
+ *   tick       dmr_cleanup_clients() on a tick with nothing due
+ *   refresh    the same with every client due but heard from since, per client
+ *   expire     the same with every client timed out, per client
+ * 
+ * Each kernel runs at every client table size given on the command line.
+ * Cycles are read from the time stamp counter where there is one, so they
+ * count reference cycles rather than core cycles under frequency scaling.
+ * 
+ * Usage: bench_micro [clients...]
+ * 
+ * Copyright (c) 2025
+ */
+
+#include "../dmr_server.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC          1
+#endif
+
+#ifdef _WIN32
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+#endif
+
+#define BENCH_RX_BUFFERS        DMR_MAX_BATCH
+#define BENCH_ORDER_SIZE        4096    /* Random client order, defeats the prefetcher */
+#define BENCH_GROUP_SIZE        16      /* Subscribers per talkgroup */
+#define BENCH_TALKGROUP_BASE    1000    /* First talkgroup ID */
+#define BENCH_OPS               2000000 /* Operations per per-frame kernel */
+#define BENCH_BROADCAST_MSGS    20000000  /* Messages per broadcast run, spread over frames */
+#define BENCH_TIMEOUT_MS        3600000 /* Client inactivity timeout, long enough to time idle ticks */
+#define BENCH_TICKS             (BENCH_TIMEOUT_MS / DMR_TIMER_TICK_MS - 2)  /* Idle ticks before the clients are due */
+
+/* Benchmark state */
+static uint8_t rx_buffers[BENCH_RX_BUFFERS][DMR_BUFFER_SIZE];
+static struct sockaddr_in tx_addrs[DMR_TX_QUEUE_SIZE];
+static struct iovec tx_iovecs[DMR_TX_QUEUE_SIZE];
+static int tx_count = 0;
+static struct sockaddr_in *client_addrs = NULL;
+static uint32_t order[BENCH_ORDER_SIZE];
+static dmr_config_t config;
+static dmr_wheel_t wheel;
+static uint64_t now_ms = 0;
+static volatile uint64_t sink = 0;
+
+/* Time stamp counter, 0 where there is none */
+static uint64_t bench_cycles(void) {
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Measured interval */
+typedef struct {
+    uint64_t nsec;
+    uint64_t cycles;
+} bench_mark_t;
+
+static bench_mark_t bench_start(void) {
+    bench_mark_t mark;
+    
+    mark.nsec = dmr_stats_clock();
+    mark.cycles = bench_cycles();
+    return mark;
+}
+
+/* Time since a mark */
+static bench_mark_t bench_elapsed(bench_mark_t mark) {
+    bench_mark_t elapsed;
+    
+    elapsed.cycles = bench_cycles() - mark.cycles;
+    elapsed.nsec = dmr_stats_clock() - mark.nsec;
+    return elapsed;
+}
+
+/* Print the time per operation of an interval */
+static void bench_report(const char *name, int clients, bench_mark_t elapsed, uint64_t ops, const char *unit) {
+    if (ops == 0) {
+        ops = 1;
+    }
+#ifdef BENCH_HAVE_TSC
+    printf("%-10s %8d %12llu %-7s %10.2f ns/op %10.1f cycles/op\n", name, clients,
+           (unsigned long long)ops, unit, (double)elapsed.nsec / ops, (double)elapsed.cycles / ops);
+#else
+    printf("%-10s %8d %12llu %-7s %10.2f ns/op %10s cycles/op\n", name, clients,
+           (unsigned long long)ops, unit, (double)elapsed.nsec / ops, "-");
+#endif
+}
+
+/* Address and DMR ID of the i-th benchmark client */
+static void bench_client_addr(int i, struct sockaddr_in *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(0x0A000000u | (uint32_t)(i >> 8));
+    addr->sin_port = htons((uint16_t)(40000 + (i & 0xFF)));
+}
+
+static uint32_t bench_client_id(int i) {
+    return 3100000 + (uint32_t)i;
+}
+
+/* Talkgroup the i-th client is subscribed to */
+static uint32_t bench_client_talkgroup(int i) {
+    return BENCH_TALKGROUP_BASE + (uint32_t)(i / BENCH_GROUP_SIZE);
+}
+
+/* Write a voice frame from a client into a receive buffer */
+static void bench_build_frame(uint8_t *buffer, int i) {
+    uint32_t src_id = bench_client_id(i);
+    uint32_t dst_id = bench_client_talkgroup(i);
+    int j;
+    
+    buffer[0] = (uint8_t)(DMR_PKT_VOICE + (i & 3));
+    buffer[1] = (i & 1) ? DMR_SLOT_2 : DMR_SLOT_1;
+    buffer[2] = (src_id >> 16) & 0xFF;
+    buffer[3] = (src_id >> 8) & 0xFF;
+    buffer[4] = src_id & 0xFF;
+    buffer[5] = (dst_id >> 16) & 0xFF;
+    buffer[6] = (dst_id >> 8) & 0xFF;
+    buffer[7] = dst_id & 0xFF;
+    for (j = DMR_FRAME_HEADER_SIZE; j < DMR_FRAME_SIZE; j++) {
+        buffer[j] = (uint8_t)(i * 31 + j);
+    }
+}
+
+/* Register clients, each subscribed to its talkgroup on both slots and due to time out together */
+static int bench_populate(int clients) {
+    int i;
+    
+    if (dmr_clients_init(clients) != 0 || dmr_route_init(&config) != 0) {
+        return -1;
+    }
+    dmr_wheel_init(&wheel, now_ms / DMR_TIMER_TICK_MS);
+    
+    for (i = 0; i < clients; i++) {
+        dmr_client_t *client = dmr_clients_insert(&client_addrs[i]);
+        
+        if (client == NULL) {
+            fprintf(stderr, "Failed to register client %d\n", i);
+            return -1;
+        }
+        client->last_seen = now_ms;
+        dmr_clients_set_id(client, bench_client_id(i));
+        dmr_route_subscribe(client, bench_client_talkgroup(i), DMR_SLOT_1, false, UINT64_MAX);
+        dmr_route_subscribe(client, bench_client_talkgroup(i), DMR_SLOT_2, false, UINT64_MAX);
+        dmr_wheel_schedule(&wheel, &client->timeout, (now_ms + BENCH_TIMEOUT_MS) / DMR_TIMER_TICK_MS + 1);
+    }
+    
+    /* Frames from random clients, visited in random order */
+    for (i = 0; i < BENCH_ORDER_SIZE; i++) {
+        order[i] = (uint32_t)(((uint64_t)rand() << 16 ^ (uint64_t)rand()) % (uint64_t)clients);
+    }
+    for (i = 0; i < BENCH_RX_BUFFERS; i++) {
+        bench_build_frame(rx_buffers[i], (int)order[i]);
+    }
+    
+    return 0;
+}
+
+/* Release the registry and routes */
+static void bench_depopulate(void) {
+    dmr_route_cleanup();
+    dmr_clients_cleanup();
+}
+
+/* Header parse and classification, as dmr_handle_datagram() does it */
+static void bench_parse(int clients) {
+    uint64_t by_type[DMR_STATS_TYPES] = { 0 };
+    uint64_t by_slot[DMR_STATS_SLOTS] = { 0 };
+    bench_mark_t mark = bench_start();
+    long i;
+    
+    for (i = 0; i < BENCH_OPS; i++) {
+        dmr_frame_view_t frame;
+        uint8_t type, slot;
+        
+        if (dmr_frame_view_init(&frame, rx_buffers[i % BENCH_RX_BUFFERS], DMR_FRAME_SIZE) != 0) {
+            continue;
+        }
+        type = dmr_frame_type(&frame);
+        slot = dmr_frame_slot(&frame);
+        by_type[type >= DMR_PKT_VOICE && type <= DMR_PKT_SYNC ? type : 0]++;
+        by_slot[slot == DMR_SLOT_1 || slot == DMR_SLOT_2 ? slot : 0]++;
+        sink += dmr_frame_src_id(&frame) ^ dmr_frame_dst_id(&frame);
+    }
+    
+    bench_report("parse", clients, bench_elapsed(mark), BENCH_OPS, "frames");
+    sink += by_type[DMR_PKT_VOICE] + by_slot[DMR_SLOT_1];
+}
+
+/* Sender lookup, group call check and subscription refresh under the read lock,
+ * as dmr_process_frame() does them for a known client */
+static void bench_lookup(int clients, dmr_rwlock_t *lock) {
+    bench_mark_t mark = bench_start();
+    long i;
+    
+    for (i = 0; i < BENCH_OPS; i++) {
+        int c = (int)order[i % BENCH_ORDER_SIZE];
+        uint32_t dst_id = bench_client_talkgroup(c);
+        uint8_t slot = (c & 1) ? DMR_SLOT_2 : DMR_SLOT_1;
+        dmr_client_t *client;
+        bool group_call;
+        
+        dmr_rwlock_rdlock(lock);
+        client = dmr_clients_lookup(&client_addrs[c]);
+        group_call = dmr_clients_lookup_id(dst_id) == NULL;
+        if (client != NULL) {
+            __atomic_store_n(&client->last_seen, now_ms, __ATOMIC_RELAXED);
+            if (group_call) {
+                sink += dmr_route_refresh(client, dst_id, slot, UINT64_MAX);
+            }
+        }
+        dmr_rwlock_rdunlock(lock);
+    }
+    
+    bench_report("lookup", clients, bench_elapsed(mark), BENCH_OPS, "frames");
+}
+
+/* Check whether two addresses are the same endpoint */
+static bool bench_same_addr(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+/* Queue one message of a fan-out as dmr_relay_to() does, dropping the queue when full */
+static void bench_queue(const uint8_t *buffer, int buffer_size, const struct sockaddr_in *addr) {
+    if (tx_count == DMR_TX_QUEUE_SIZE) {
+        sink += tx_iovecs[tx_count - 1].iov_len;
+        tx_count = 0;
+    }
+    tx_addrs[tx_count] = *addr;
+    tx_iovecs[tx_count].iov_base = (void *)buffer;
+    tx_iovecs[tx_count].iov_len = buffer_size;
+    tx_count++;
+}
+
+/* Fan-out build of dmr_relay_frame() for group calls or broadcast routing */
+static void bench_relay(int clients, dmr_rwlock_t *lock, bool broadcast) {
+    long frames = broadcast ? BENCH_BROADCAST_MSGS / clients : BENCH_OPS;
+    uint64_t messages = 0;
+    bench_mark_t mark, elapsed;
+    long i;
+    int j;
+    
+    if (frames < 16) {
+        frames = 16;
+    }
+    
+    mark = bench_start();
+    for (i = 0; i < frames; i++) {
+        const struct sockaddr_in *exclude = &client_addrs[order[i % BENCH_RX_BUFFERS]];
+        dmr_frame_view_t frame;
+        int count;
+        
+        dmr_frame_view_init(&frame, rx_buffers[i % BENCH_RX_BUFFERS], DMR_FRAME_SIZE);
+        
+        dmr_rwlock_rdlock(lock);
+        if (broadcast) {
+            const struct sockaddr_in *peers = dmr_clients_peers(&count);
+            
+            for (j = 0; j < count; j++) {
+                if (!bench_same_addr(&peers[j], exclude)) {
+                    bench_queue(frame.data, frame.length, &peers[j]);
+                    messages++;
+                }
+            }
+        } else if (dmr_clients_lookup_id(dmr_frame_dst_id(&frame)) == NULL) {
+            const dmr_route_member_t *members =
+                dmr_route_members(dmr_frame_dst_id(&frame), dmr_frame_slot(&frame), &count);
+            
+            for (j = 0; j < count; j++) {
+                if (!bench_same_addr(&members[j].addr, exclude)) {
+                    bench_queue(frame.data, frame.length, &members[j].addr);
+                    messages++;
+                }
+            }
+        }
+        dmr_rwlock_rdunlock(lock);
+        
+        /* One flush per frame, as outside a receive batch */
+        tx_count = 0;
+    }
+    
+    elapsed = bench_elapsed(mark);
+    bench_report(broadcast ? "broadcast" : "group", clients, elapsed, frames, "frames");
+    bench_report(broadcast ? "broadcast" : "group", clients, elapsed, messages, "msgs");
+}
+
+/* Advance the wheel as dmr_cleanup_clients() does, expiring or rescheduling
+ * what is due; returns the number of timers handled */
+static int bench_cleanup_pass(void) {
+    dmr_timer_t *due[DMR_EXPIRE_SLICE];
+    dmr_client_t expired[DMR_EXPIRE_SLICE];
+    int count;
+    int i;
+    
+    count = dmr_wheel_advance(&wheel, now_ms / DMR_TIMER_TICK_MS, due, DMR_EXPIRE_SLICE);
+    for (i = 0; i < count; i++) {
+        dmr_client_t *client = (dmr_client_t *)((char *)due[i] - offsetof(dmr_client_t, timeout));
+        
+        if (now_ms - client->last_seen > BENCH_TIMEOUT_MS) {
+            expired[i] = *client;
+            dmr_route_client_removed(client);
+            dmr_clients_erase(client);
+            sink += expired[i].dmr_id;
+        } else {
+            dmr_wheel_schedule(&wheel, &client->timeout,
+                               (client->last_seen + BENCH_TIMEOUT_MS) / DMR_TIMER_TICK_MS + 1);
+        }
+    }
+    sink += dmr_clients_count();
+    
+    return count;
+}
+
+/* Run cleanup once a tick up to just before freshly populated clients fall due */
+static void bench_idle_ticks(dmr_rwlock_t *lock) {
+    long i;
+    
+    for (i = 0; i < BENCH_TICKS; i++) {
+        now_ms += DMR_TIMER_TICK_MS;
+        dmr_rwlock_wrlock(lock);
+        bench_cleanup_pass();
+        dmr_rwlock_wrunlock(lock);
+    }
+}
+
+/* Run cleanup on the tick every client falls due, until it has handled them all */
+static uint64_t bench_due_tick(dmr_rwlock_t *lock, bench_mark_t *total) {
+    uint64_t handled = 0;
+    bench_mark_t mark, elapsed;
+    int count;
+    
+    now_ms += DMR_TIMER_TICK_MS * 3;
+    mark = bench_start();
+    do {
+        dmr_rwlock_wrlock(lock);
+        count = bench_cleanup_pass();
+        dmr_rwlock_wrunlock(lock);
+        handled += count;
+    } while (count == DMR_EXPIRE_SLICE);
+    elapsed = bench_elapsed(mark);
+    
+    total->nsec += elapsed.nsec;
+    total->cycles += elapsed.cycles;
+    return handled;
+}
+
+/* Cleanup on idle ticks, then with every client due, once heard from since and once not.
+ * Small tables repeat the due tick over fresh clients so there is enough to time. */
+static int bench_cleanup(int clients, dmr_rwlock_t *lock) {
+    int rounds = clients < BENCH_ORDER_SIZE ? BENCH_ORDER_SIZE / clients : 1;
+    bench_mark_t refreshed = { 0, 0 };
+    bench_mark_t expired = { 0, 0 };
+    uint64_t refresh_count = 0;
+    uint64_t expire_count = 0;
+    bench_mark_t mark;
+    int r, i;
+    
+    mark = bench_start();
+    bench_idle_ticks(lock);
+    bench_report("tick", clients, bench_elapsed(mark), BENCH_TICKS, "ticks");
+    
+    for (r = 0; r < rounds; r++) {
+        /* Every client due but heard from just now */
+        if (r > 0) {
+            bench_depopulate();
+            if (bench_populate(clients) != 0) {
+                return -1;
+            }
+            bench_idle_ticks(lock);
+        }
+        for (i = 0; i < clients; i++) {
+            dmr_clients_lookup(&client_addrs[i])->last_seen = now_ms;
+        }
+        refresh_count += bench_due_tick(lock, &refreshed);
+        
+        /* Every client timed out */
+        bench_depopulate();
+        if (bench_populate(clients) != 0) {
+            return -1;
+        }
+        bench_idle_ticks(lock);
+        expire_count += bench_due_tick(lock, &expired);
+        
+        if (dmr_clients_count() != 0) {
+            fprintf(stderr, "Warning: %d clients left after expiry\n", dmr_clients_count());
+        }
+    }
+    
+    bench_report("refresh", clients, refreshed, refresh_count, "clients");
+    bench_report("expire", clients, expired, expire_count, "clients");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    static const int default_sizes[] = { 16, 256, 4096, 65536 };
+    dmr_rwlock_t lock = DMR_RWLOCK_INITIALIZER;
+    int sizes[32];
+    int size_count = 0;
+    int max_size = 0;
+    int i, s;
+    
+    for (i = 1; i < argc && size_count < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        sizes[size_count] = atoi(argv[i]);
+        if (sizes[size_count] < 2) {
+            fprintf(stderr, "Usage: %s [clients...]\n", argv[0]);
+            return 1;
+        }
+        size_count++;
+    }
+    if (size_count == 0) {
+        size_count = (int)(sizeof(default_sizes) / sizeof(default_sizes[0]));
+        memcpy(sizes, default_sizes, sizeof(default_sizes));
+    }
+    for (s = 0; s < size_count; s++) {
+        if (sizes[s] > max_size) {
+            max_size = sizes[s];
+        }
+    }
+    
+    client_addrs = malloc((size_t)max_size * sizeof(struct sockaddr_in));
+    if (client_addrs == NULL) {
+        return 1;
+    }
+    for (i = 0; i < max_size; i++) {
+        bench_client_addr(i, &client_addrs[i]);
+    }
+    
+    srand(1);
+    now_ms = 1000000;
+    printf("Microbenchmarks: %d subscribers per talkgroup, slices of %d expiries\n",
+           BENCH_GROUP_SIZE, DMR_EXPIRE_SLICE);
+    printf("%-10s %8s %12s %-7s\n", "kernel", "clients", "ops", "unit");
+    
+    for (s = 0; s < size_count; s++) {
+        if (bench_populate(sizes[s]) != 0) {
+            return 1;
+        }
+        bench_parse(sizes[s]);
+        bench_lookup(sizes[s], &lock);
+        bench_relay(sizes[s], &lock, false);
+        bench_relay(sizes[s], &lock, true);
+        if (bench_cleanup(sizes[s], &lock) != 0) {
+            return 1;
+        }
+        bench_depopulate();
+    }
+    
+    free(client_addrs);
+    return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * DMR Voice Relay Server - Load Generator
+ * 
+ * This file contains dmr_bench, a synthetic load generator. It simulates
+ * a number of repeaters, each with its own UDP socket, that transmit
+ * 33-byte voice frames on both slots every DMR_SLOT_TIME_MS to a running
+ * dmr_server, spread evenly over the slot time. Every frame carries its
+ * send time, so the repeaters receiving the relayed copies can measure
+ * relay latency. At the end it reports delivered packets per second, loss
+ * against the deliveries the routing mode should produce, and latency
+ * percentiles, as text, CSV or JSON.
+ * 
+ * POSIX only.
+ * 
+ * Copyright (c) 2025
+ */
+
+#include "../dmr_server.h"
+#include <poll.h>
+
+#define BENCH_SRC_BASE          3100000 /* DMR ID of the first simulated repeater */
+#define BENCH_TG_BASE           1000    /* First talkgroup */
+#define BENCH_WARMUP_MS         300     /* Wait after registering before measuring */
+#define BENCH_DRAIN_MS          500     /* Wait for relayed frames after the last send */
+#define BENCH_STAMP_OFFSET      DMR_FRAME_HEADER_SIZE  /* Payload bytes holding the send time */
+
+/* Output formats */
+#define BENCH_TEXT              0
+#define BENCH_CSV               1
+#define BENCH_JSON              2
+
+/* Simulated repeater */
+typedef struct {
+    uint32_t src_id;                    /* DMR ID */
+    uint32_t talkgroup;                 /* Talkgroup it transmits on, both slots */
+} bench_repeater_t;
+
+/* Benchmark settings and results */
+typedef struct {
+    const char *host;
+    uint16_t port;
+    int repeaters;
+    int talkgroups;
+    int duration;
+    bool broadcast;
+    int format;
+    const char *label;
+    uint64_t frames_sent;
+    uint64_t expected;
+    uint64_t received;
+    uint64_t elapsed_nsec;
+    dmr_latency_t latency;
+} bench_t;
+
+/* Global variables */
+static bench_repeater_t *repeaters = NULL;
+static struct pollfd *sockets = NULL;
+
+/* Build and send one frame from a repeater */
+static int bench_send(struct sockaddr_in *server, int index, uint8_t slot, bool stamp) {
+    uint8_t frame[DMR_FRAME_SIZE];
+    uint32_t src_id = repeaters[index].src_id;
+    uint32_t dst_id = repeaters[index].talkgroup;
+    uint64_t now;
+    
+    memset(frame, 0, sizeof(frame));
+    frame[0] = DMR_PKT_VOICE;
+    frame[1] = slot;
+    frame[2] = (src_id >> 16) & 0xFF;
+    frame[3] = (src_id >> 8) & 0xFF;
+    frame[4] = src_id & 0xFF;
+    frame[5] = (dst_id >> 16) & 0xFF;
+    frame[6] = (dst_id >> 8) & 0xFF;
+    frame[7] = dst_id & 0xFF;
+    
+    /* Registration frames carry no send time and are not measured */
+    now = stamp ? dmr_stats_clock() : 0;
+    memcpy(frame + BENCH_STAMP_OFFSET, &now, sizeof(now));
+    
+    if (sendto(sockets[index].fd, frame, sizeof(frame), 0, (struct sockaddr *)server, sizeof(*server)) < 0) {
+        perror("sendto");
+        return -1;
+    }
+    return 0;
+}
+
+/* Receive every relayed frame waiting on a repeater's socket */
+static void bench_drain(bench_t *bench, int index) {
+    uint8_t frame[DMR_BUFFER_SIZE];
+    uint64_t sent;
+    ssize_t n;
+    
+    while ((n = recv(sockets[index].fd, frame, sizeof(frame), MSG_DONTWAIT)) > 0) {
+        if (n < BENCH_STAMP_OFFSET + (ssize_t)sizeof(sent)) {
+            continue;
+        }
+        memcpy(&sent, frame + BENCH_STAMP_OFFSET, sizeof(sent));
+        if (sent == 0) {
+            continue;
+        }
+        bench->received++;
+        dmr_latency_record(&bench->latency, dmr_stats_clock() - sent);
+    }
+}
+
+/* Poll every socket until a deadline, draining what arrives */
+static void bench_poll(bench_t *bench, uint64_t deadline) {
+    uint64_t now = dmr_stats_clock();
+    int i;
+    
+    while (now < deadline) {
+        int timeout = (int)((deadline - now + 999999) / 1000000);
+        
+        if (poll(sockets, bench->repeaters, timeout) > 0) {
+            for (i = 0; i < bench->repeaters; i++) {
+                if (sockets[i].revents & POLLIN) {
+                    bench_drain(bench, i);
+                }
+            }
+        }
+        now = dmr_stats_clock();
+    }
+}
+
+/* Relayed copies one frame from a repeater should produce */
+static uint64_t bench_recipients(bench_t *bench, int index) {
+    int members;
+    
+    if (bench->broadcast) {
+        return bench->repeaters - 1;
+    }
+    
+    /* Repeaters share talkgroups round-robin */
+    members = bench->repeaters / bench->talkgroups;
+    if (index % bench->talkgroups < bench->repeaters % bench->talkgroups) {
+        members++;
+    }
+    return members - 1;
+}
+
+/* Register every repeater, then transmit for the configured duration */
+static int bench_run(bench_t *bench) {
+    struct sockaddr_in server;
+    uint64_t slot_nsec = (uint64_t)DMR_SLOT_TIME_MS * 1000000;
+    uint64_t start, end, next;
+    uint64_t round = 0;
+    int index = 0;
+    int i;
+    
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(bench->port);
+    if (inet_pton(AF_INET, bench->host, &server.sin_addr) <= 0) {
+        fprintf(stderr, "Invalid server address: %s\n", bench->host);
+        return -1;
+    }
+    
+    repeaters = calloc(bench->repeaters, sizeof(bench_repeater_t));
+    sockets = calloc(bench->repeaters, sizeof(struct pollfd));
+    if (repeaters == NULL || sockets == NULL) {
+        fprintf(stderr, "Failed to allocate %d repeaters\n", bench->repeaters);
+        return -1;
+    }
+    
+    for (i = 0; i < bench->repeaters; i++) {
+        repeaters[i].src_id = BENCH_SRC_BASE + i;
+        repeaters[i].talkgroup = BENCH_TG_BASE + i % bench->talkgroups;
+        sockets[i].fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        sockets[i].events = POLLIN;
+        if (sockets[i].fd < 0) {
+            perror("socket");
+            return -1;
+        }
+    }
+    
+    /* Register and subscribe every repeater on both slots */
+    for (i = 0; i < bench->repeaters; i++) {
+        if (bench_send(&server, i, DMR_SLOT_1, false) != 0 ||
+            bench_send(&server, i, DMR_SLOT_2, false) != 0) {
+            return -1;
+        }
+    }
+    bench_poll(bench, dmr_stats_clock() + (uint64_t)BENCH_WARMUP_MS * 1000000);
+    bench->received = 0;
+    memset(&bench->latency, 0, sizeof(bench->latency));
+    
+    /* Each repeater transmits once per slot time, offset evenly within it */
+    start = dmr_stats_clock();
+    end = start + (uint64_t)bench->duration * 1000000000ULL;
+    next = start;
+    while (next < end) {
+        if (bench_send(&server, index, DMR_SLOT_1, true) != 0 ||
+            bench_send(&server, index, DMR_SLOT_2, true) != 0) {
+            return -1;
+        }
+        bench->frames_sent += 2;
+        bench->expected += 2 * bench_recipients(bench, index);
+        
+        if (++index == bench->repeaters) {
+            index = 0;
+            round++;
+        }
+        next = start + round * slot_nsec + slot_nsec * index / bench->repeaters;
+        bench_poll(bench, next);
+    }
+    bench->elapsed_nsec = dmr_stats_clock() - start;
+    
+    /* Collect frames still in flight */
+    bench_poll(bench, dmr_stats_clock() + (uint64_t)BENCH_DRAIN_MS * 1000000);
+    
+    for (i = 0; i < bench->repeaters; i++) {
+        close(sockets[i].fd);
+    }
+    free(sockets);
+    free(repeaters);
+    return 0;
+}
+
+/* Print the results in the chosen format */
+static void bench_report(bench_t *bench) {
+    double seconds = bench->elapsed_nsec / 1e9;
+    double pps = seconds > 0 ? bench->received / seconds : 0;
+    double loss = bench->expected > 0 ? 100.0 * (1.0 - (double)bench->received / bench->expected) : 0;
+    double p50 = dmr_latency_percentile(&bench->latency, 50.0) / 1000.0;
+    double p99 = dmr_latency_percentile(&bench->latency, 99.0) / 1000.0;
+    double p999 = dmr_latency_percentile(&bench->latency, 99.9) / 1000.0;
+    double max = bench->latency.max / 1000.0;
+    
+    if (bench->format == BENCH_CSV) {
+        printf("label,repeaters,talkgroups,routing,seconds,frames_sent,expected,received,"
+               "delivered_pps,loss_pct,latency_p50_us,latency_p99_us,latency_p999_us,latency_max_us\n");
+        printf("%s,%d,%d,%s,%.3f,%llu,%llu,%llu,%.1f,%.4f,%.1f,%.1f,%.1f,%.1f\n",
+               bench->label, bench->repeaters, bench->talkgroups,
+               bench->broadcast ? "broadcast" : "talkgroup", seconds,
+               (unsigned long long)bench->frames_sent, (unsigned long long)bench->expected,
+               (unsigned long long)bench->received, pps, loss, p50, p99, p999, max);
+    } else if (bench->format == BENCH_JSON) {
+        printf("{\"label\":\"%s\",\"repeaters\":%d,\"talkgroups\":%d,\"routing\":\"%s\","
+               "\"seconds\":%.3f,\"frames_sent\":%llu,\"expected\":%llu,\"received\":%llu,"
+               "\"delivered_pps\":%.1f,\"loss_pct\":%.4f,\"latency_us\":{\"p50\":%.1f,"
+               "\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+               bench->label, bench->repeaters, bench->talkgroups,
+               bench->broadcast ? "broadcast" : "talkgroup", seconds,
+               (unsigned long long)bench->frames_sent, (unsigned long long)bench->expected,
+               (unsigned long long)bench->received, pps, loss, p50, p99, p999, max);
+    } else {
+        printf("Repeaters: %d on %d talkgroups (%s routing), %.1f s\n", bench->repeaters,
+               bench->talkgroups, bench->broadcast ? "broadcast" : "talkgroup", seconds);
+        printf("Frames sent: %llu, relayed copies expected: %llu, received: %llu\n",
+               (unsigned long long)bench->frames_sent, (unsigned long long)bench->expected,
+               (unsigned long long)bench->received);
+        printf("Delivered: %.1f packets/s, loss: %.4f%%\n", pps, loss);
+        printf("Relay latency: p50=%.1f p99=%.1f p99.9=%.1f max=%.1f us\n", p50, p99, p999, max);
+    }
+}
+
+/* Print usage */
+static void bench_usage(const char *program_name) {
+    printf("Usage: %s [options]\n", program_name);
+    printf("Options:\n");
+    printf("  -s ADDR     Server address (default: 127.0.0.1)\n");
+    printf("  -p PORT     Server port (default: %d)\n", DMR_SERVER_PORT);
+    printf("  -n N        Simulated repeaters (default: 10)\n");
+    printf("  -g N        Talkgroups the repeaters are spread over (default: 1)\n");
+    printf("  -d SECONDS  Measured duration (default: 10)\n");
+    printf("  -r MODE     Server routing mode, talkgroup or broadcast (default: talkgroup)\n");
+    printf("  -f FORMAT   Output format, text, csv or json (default: text)\n");
+    printf("  -l LABEL    Label for the csv/json record, e.g. a release (default: none)\n");
+    printf("  -h          Print this help message\n");
+}
+
+int main(int argc, char *argv[]) {
+    bench_t bench;
+    int i;
+    
+    memset(&bench, 0, sizeof(bench));
+    bench.host = "127.0.0.1";
+    bench.port = DMR_SERVER_PORT;
+    bench.repeaters = 10;
+    bench.talkgroups = 1;
+    bench.duration = 10;
+    bench.format = BENCH_TEXT;
+    bench.label = "";
+    
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            bench.host = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            bench.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            bench.repeaters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            bench.talkgroups = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            bench.duration = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            bench.broadcast = strcmp(argv[++i], "broadcast") == 0;
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            i++;
+            bench.format = strcmp(argv[i], "csv") == 0 ? BENCH_CSV :
+                           strcmp(argv[i], "json") == 0 ? BENCH_JSON : BENCH_TEXT;
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            bench.label = argv[++i];
+        } else if (strcmp(argv[i], "-h") == 0) {
+            bench_usage(argv[0]);
+            return 0;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            bench_usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (bench.repeaters < 2 || bench.talkgroups < 1 || bench.talkgroups > bench.repeaters ||
+        bench.duration < 1) {
+        fprintf(stderr, "Need at least 2 repeaters, 1 to %d talkgroups and 1 second\n", bench.repeaters);
+        return 1;
+    }
+    
+    if (bench_run(&bench) != 0) {
+        return 1;
+    }
+    bench_report(&bench);
+    
+    return 0;
+}
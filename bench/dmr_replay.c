@@ -0,0 +1,713 @@
+/*
+ * DMR Voice Relay Server - Capture Replay
+ * 
+ * This file contains dmr_replay, which replays the UDP datagrams sent to
+ * the DMR port in a pcap or pcapng capture against a running dmr_server.
+ * Captures are read without libpcap: classic pcap in either byte order
+ * with microsecond or nanosecond timestamps, and pcapng section, interface,
+ * enhanced and simple packet blocks, over Ethernet (with VLAN tags), Linux
+ * cooked, raw IPv4 and loopback link types. Every source address in the
+ * capture gets a socket of its own, so the server sees as many clients as
+ * the capture had.
+ * 
+ * Datagrams are replayed with their original timing, sped up by a factor,
+ * or as fast as possible. When the server serves OpenMetrics, its counters
+ * and relay latency histograms are scraped before and after the replay
+ * and the difference is reported per stage, so only the replayed traffic
+ * is measured, by the server's own instrumentation.
+ * 
+ * POSIX only.
+ * 
+ * Copyright (c) 2025
+ */
+
+#include "../dmr_server.h"
+#include <poll.h>
+
+#define REPLAY_MAX_SOURCES      32768   /* Distinct source addresses, one socket each */
+#define REPLAY_SOURCE_BUCKETS   65536   /* Source hash table size, twice the above */
+#define REPLAY_MAX_INTERFACES   16      /* pcapng interfaces per section */
+#define REPLAY_MAX_LE           64      /* Histogram buckets per latency stage */
+#define REPLAY_MAX_REASONS      16      /* Error reasons kept from a scrape */
+#define REPLAY_DRAIN_MS         500     /* Wait for relayed frames after the last send */
+#define REPLAY_DRAIN_EVERY      64      /* Sends between socket drains at full speed */
+#define REPLAY_SCRAPE_SIZE      (1 << 20)  /* Largest metrics response */
+
+/* Timing modes */
+#define REPLAY_ORIGINAL         0       /* Capture timing */
+#define REPLAY_SPEEDUP          1       /* Capture timing divided by a factor */
+#define REPLAY_MAX_RATE         2       /* No waiting */
+
+/* pcap link types */
+#define LINKTYPE_NULL           0
+#define LINKTYPE_ETHERNET       1
+#define LINKTYPE_RAW_BSD        12
+#define LINKTYPE_RAW            101
+#define LINKTYPE_LINUX_SLL      113
+#define LINKTYPE_IPV4           228
+#define LINKTYPE_LINUX_SLL2     276
+
+/* Datagram to replay */
+typedef struct {
+    uint64_t time;                      /* Capture time, nanoseconds */
+    const uint8_t *data;                /* UDP payload, inside the capture buffer */
+    uint32_t length;                    /* UDP payload length */
+    uint32_t source;                    /* Index of the source address */
+} replay_packet_t;
+
+/* pcapng interface */
+typedef struct {
+    uint16_t link_type;
+    uint64_t units_per_sec;             /* Timestamp resolution */
+} replay_interface_t;
+
+/* One latency stage as scraped */
+typedef struct {
+    double le[REPLAY_MAX_LE];           /* Bucket upper bounds, +Inf last */
+    uint64_t cumulative[REPLAY_MAX_LE]; /* Cumulative counts */
+    int buckets;
+    double sum;                         /* Seconds */
+    uint64_t count;
+} replay_stage_t;
+
+/* Server metrics as scraped */
+typedef struct {
+    bool valid;
+    uint64_t received;
+    uint64_t relayed;
+    int clients;
+    replay_stage_t stages[DMR_LAT_STAGES];
+    char reasons[REPLAY_MAX_REASONS][24];
+    uint64_t errors[REPLAY_MAX_REASONS];
+    int reason_count;
+} replay_metrics_t;
+
+/* Stage names as served by dmr_metrics.c */
+static const char *stage_names[DMR_LAT_STAGES] = { "receive_process", "process_first_send", "process_last_send" };
+
+/* Global variables */
+static replay_packet_t *packets = NULL;
+static size_t packet_count = 0;
+static size_t packet_capacity = 0;
+static uint64_t source_keys[REPLAY_MAX_SOURCES];
+static int32_t source_buckets[REPLAY_SOURCE_BUCKETS];
+static struct pollfd *sockets = NULL;
+static int source_count = 0;
+static uint16_t filter_port = DMR_SERVER_PORT;
+static uint64_t skipped = 0;
+static uint64_t relayed_back = 0;
+
+/* Read integers from the capture in its byte order */
+static uint16_t replay_u16(const uint8_t *p, bool swap) {
+    return swap ? (uint16_t)(p[0] << 8 | p[1]) : (uint16_t)(p[1] << 8 | p[0]);
+}
+
+static uint32_t replay_u32(const uint8_t *p, bool swap) {
+    return swap ? (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]
+                : (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+}
+
+/* Index of a source address, adding it if new; -1 when there are too many */
+static int replay_source(uint32_t addr, uint16_t port) {
+    uint64_t key = (uint64_t)addr << 16 | port;
+    uint32_t bucket = (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 48) & (REPLAY_SOURCE_BUCKETS - 1);
+    
+    while (source_buckets[bucket] >= 0) {
+        if (source_keys[source_buckets[bucket]] == key) {
+            return source_buckets[bucket];
+        }
+        bucket = (bucket + 1) & (REPLAY_SOURCE_BUCKETS - 1);
+    }
+    
+    if (source_count == REPLAY_MAX_SOURCES) {
+        return -1;
+    }
+    source_keys[source_count] = key;
+    source_buckets[bucket] = source_count;
+    return source_count++;
+}
+
+/* Keep a captured frame if it is an IPv4 UDP datagram to the DMR port */
+static void replay_add_frame(uint16_t link_type, uint64_t time, const uint8_t *frame, uint32_t length) {
+    const uint8_t *ip = NULL;
+    const uint8_t *udp;
+    uint32_t header, total, udp_length;
+    uint16_t ethertype;
+    int source;
+    
+    /* Find the IPv4 header */
+    switch (link_type) {
+    case LINKTYPE_ETHERNET:
+        if (length < 14) {
+            break;
+        }
+        header = 12;
+        ethertype = (uint16_t)(frame[header] << 8 | frame[header + 1]);
+        while ((ethertype == 0x8100 || ethertype == 0x88A8) && length >= header + 6) {
+            header += 4;
+            ethertype = (uint16_t)(frame[header] << 8 | frame[header + 1]);
+        }
+        if (ethertype == 0x0800) {
+            ip = frame + header + 2;
+            length -= header + 2;
+        }
+        break;
+    
+    case LINKTYPE_LINUX_SLL:
+        if (length >= 16 && frame[14] == 0x08 && frame[15] == 0x00) {
+            ip = frame + 16;
+            length -= 16;
+        }
+        break;
+    
+    case LINKTYPE_LINUX_SLL2:
+        if (length >= 20 && frame[0] == 0x08 && frame[1] == 0x00) {
+            ip = frame + 20;
+            length -= 20;
+        }
+        break;
+    
+    case LINKTYPE_NULL:
+        /* Address family in the capturing host's byte order */
+        if (length >= 4 && (replay_u32(frame, false) == 2 || replay_u32(frame, true) == 2)) {
+            ip = frame + 4;
+            length -= 4;
+        }
+        break;
+    
+    case LINKTYPE_RAW:
+    case LINKTYPE_RAW_BSD:
+    case LINKTYPE_IPV4:
+        ip = frame;
+        break;
+    }
+    
+    /* Unfragmented IPv4 carrying UDP to the DMR port */
+    if (ip == NULL || length < 20 || (ip[0] >> 4) != 4 || ip[9] != IPPROTO_UDP ||
+        ((ip[6] & 0x3F) | ip[7]) != 0) {
+        skipped++;
+        return;
+    }
+    header = (ip[0] & 0x0F) * 4;
+    total = (uint32_t)(ip[2] << 8 | ip[3]);
+    if (total > length) {
+        total = length;
+    }
+    if (header < 20 || total < header + 8) {
+        skipped++;
+        return;
+    }
+    udp = ip + header;
+    udp_length = (uint32_t)(udp[4] << 8 | udp[5]);
+    if ((uint16_t)(udp[2] << 8 | udp[3]) != filter_port || udp_length < 8 || udp_length > total - header) {
+        skipped++;
+        return;
+    }
+    
+    source = replay_source((uint32_t)ip[12] << 24 | (uint32_t)ip[13] << 16 | (uint32_t)ip[14] << 8 | ip[15],
+                           (uint16_t)(udp[0] << 8 | udp[1]));
+    if (source < 0) {
+        skipped++;
+        return;
+    }
+    
+    if (packet_count == packet_capacity) {
+        size_t capacity = packet_capacity ? packet_capacity * 2 : 4096;
+        replay_packet_t *grown = realloc(packets, capacity * sizeof(replay_packet_t));
+        if (grown == NULL) {
+            skipped++;
+            return;
+        }
+        packets = grown;
+        packet_capacity = capacity;
+    }
+    
+    packets[packet_count].time = time;
+    packets[packet_count].data = udp + 8;
+    packets[packet_count].length = udp_length - 8;
+    packets[packet_count].source = (uint32_t)source;
+    packet_count++;
+}
+
+/* Read a classic pcap capture */
+static int replay_read_pcap(const uint8_t *data, size_t size) {
+    uint32_t magic = replay_u32(data, false);
+    bool swap = magic == 0xD4C3B2A1 || magic == 0x4D3CB2A1;
+    bool nanosec = magic == 0xA1B23C4D || magic == 0x4D3CB2A1;
+    uint16_t link_type = (uint16_t)replay_u32(data + 20, swap);
+    size_t offset = 24;
+    
+    while (offset + 16 <= size) {
+        uint64_t sec = replay_u32(data + offset, swap);
+        uint64_t frac = replay_u32(data + offset + 4, swap);
+        uint32_t length = replay_u32(data + offset + 8, swap);
+        
+        if (length > size - offset - 16) {
+            fprintf(stderr, "Truncated pcap record at offset %lu\n", (unsigned long)offset);
+            break;
+        }
+        replay_add_frame(link_type, sec * 1000000000ULL + (nanosec ? frac : frac * 1000),
+                         data + offset + 16, length);
+        offset += 16 + length;
+    }
+    
+    return 0;
+}
+
+/* Convert a pcapng timestamp to nanoseconds */
+static uint64_t replay_pcapng_time(uint64_t units, uint64_t units_per_sec) {
+    return units / units_per_sec * 1000000000ULL + units % units_per_sec * 1000000000ULL / units_per_sec;
+}
+
+/* Read a pcapng capture */
+static int replay_read_pcapng(const uint8_t *data, size_t size) {
+    replay_interface_t interfaces[REPLAY_MAX_INTERFACES];
+    int interface_count = 0;
+    uint64_t last_time = 0;
+    bool swap = false;
+    size_t offset = 0;
+    
+    while (offset + 12 <= size) {
+        uint32_t type = replay_u32(data + offset, swap);
+        uint32_t length;
+        const uint8_t *body;
+        
+        /* A section header sets the byte order for everything up to the next one */
+        if (replay_u32(data + offset, false) == 0x0A0D0D0A) {
+            swap = replay_u32(data + offset + 8, false) != 0x1A2B3C4D;
+            type = 0x0A0D0D0A;
+            interface_count = 0;
+        }
+        length = replay_u32(data + offset + 4, swap);
+        if (length < 12 || length > size - offset || (length & 3) != 0) {
+            fprintf(stderr, "Bad pcapng block at offset %lu\n", (unsigned long)offset);
+            break;
+        }
+        body = data + offset + 8;
+        
+        if (type == 1 && length >= 20 && interface_count < REPLAY_MAX_INTERFACES) {
+            /* Interface description, look for if_tsresol among its options */
+            replay_interface_t *iface = &interfaces[interface_count++];
+            size_t option = 8;
+            
+            iface->link_type = replay_u16(body, swap);
+            iface->units_per_sec = 1000000;
+            while (option + 4 <= length - 12) {
+                uint16_t code = replay_u16(body + option, swap);
+                uint16_t option_length = replay_u16(body + option + 2, swap);
+                
+                if (code == 0) {
+                    break;
+                }
+                if (code == 9 && option_length >= 1) {
+                    uint8_t resolution = body[option + 4];
+                    uint64_t units = 1;
+                    int i;
+                    
+                    for (i = 0; i < (resolution & 0x7F) && units < 1000000000000000000ULL; i++) {
+                        units *= (resolution & 0x80) ? 2 : 10;
+                    }
+                    iface->units_per_sec = units;
+                }
+                option += 4 + ((option_length + 3u) & ~3u);
+            }
+        } else if (type == 6 && length >= 32) {
+            /* Enhanced packet */
+            uint32_t id = replay_u32(body, swap);
+            uint64_t units = (uint64_t)replay_u32(body + 4, swap) << 32 | replay_u32(body + 8, swap);
+            uint32_t captured = replay_u32(body + 12, swap);
+            
+            if (id < (uint32_t)interface_count && captured <= length - 32) {
+                last_time = replay_pcapng_time(units, interfaces[id].units_per_sec);
+                replay_add_frame(interfaces[id].link_type, last_time, body + 20, captured);
+            }
+        } else if (type == 3 && length >= 16 && interface_count > 0) {
+            /* Simple packet, no timestamp of its own */
+            uint32_t original = replay_u32(body, swap);
+            uint32_t captured = original < length - 16 ? original : length - 16;
+            
+            replay_add_frame(interfaces[0].link_type, last_time, body + 4, captured);
+        }
+        
+        offset += length;
+    }
+    
+    return 0;
+}
+
+/* Scrape the server's metrics endpoint; returns false if it is not serving */
+static bool replay_scrape(const char *host, int port, replay_metrics_t *metrics, char *response) {
+    struct sockaddr_in addr;
+    const char *request = "GET /metrics HTTP/1.0\r\n\r\n";
+    size_t received = 0;
+    char *line, *next;
+    int sock;
+    ssize_t n;
+    
+    memset(metrics, 0, sizeof(*metrics));
+    if (port <= 0) {
+        return false;
+    }
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) <= 0) {
+        return false;
+    }
+    
+    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0) {
+        return false;
+    }
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        send(sock, request, strlen(request), 0) < 0) {
+        close(sock);
+        return false;
+    }
+    while (received < REPLAY_SCRAPE_SIZE - 1 &&
+           (n = recv(sock, response + received, REPLAY_SCRAPE_SIZE - 1 - received, 0)) > 0) {
+        received += (size_t)n;
+    }
+    close(sock);
+    response[received] = '\0';
+    
+    line = strstr(response, "\r\n\r\n");
+    if (strncmp(response, "HTTP/1.1 200", 12) != 0 || line == NULL) {
+        return false;
+    }
+    
+    /* Pick out the lines the report needs */
+    for (line += 4; line != NULL && *line != '\0'; line = next) {
+        char *brace;
+        int s;
+        
+        next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        
+        if (strncmp(line, "dmr_packets_received_total ", 27) == 0) {
+            metrics->received = strtoull(line + 27, NULL, 10);
+        } else if (strncmp(line, "dmr_packets_relayed_total ", 26) == 0) {
+            metrics->relayed = strtoull(line + 26, NULL, 10);
+        } else if (strncmp(line, "dmr_clients ", 12) == 0) {
+            metrics->clients = atoi(line + 12);
+        } else if (strncmp(line, "dmr_errors_total{reason=\"", 25) == 0 &&
+                   metrics->reason_count < REPLAY_MAX_REASONS && (brace = strchr(line, '}')) != NULL) {
+            int r = metrics->reason_count++;
+            size_t name_length = strcspn(line + 25, "\"");
+            
+            if (name_length >= sizeof(metrics->reasons[r])) {
+                name_length = sizeof(metrics->reasons[r]) - 1;
+            }
+            memcpy(metrics->reasons[r], line + 25, name_length);
+            metrics->reasons[r][name_length] = '\0';
+            metrics->errors[r] = strtoull(brace + 1, NULL, 10);
+        } else if (strncmp(line, "dmr_relay_latency_seconds_", 26) == 0 &&
+                   (brace = strchr(line, '}')) != NULL) {
+            for (s = 0; s < DMR_LAT_STAGES; s++) {
+                char label[64];
+                snprintf(label, sizeof(label), "{stage=\"%s\"", stage_names[s]);
+                if (strstr(line, label) != NULL) {
+                    break;
+                }
+            }
+            if (s == DMR_LAT_STAGES) {
+                continue;
+            }
+            
+            if (strncmp(line + 26, "bucket", 6) == 0 && metrics->stages[s].buckets < REPLAY_MAX_LE) {
+                replay_stage_t *stage = &metrics->stages[s];
+                char *le = strstr(line, "le=\"");
+                
+                if (le != NULL) {
+                    stage->le[stage->buckets] = strncmp(le + 4, "+Inf", 4) == 0 ? -1.0 : strtod(le + 4, NULL);
+                    stage->cumulative[stage->buckets] = strtoull(brace + 1, NULL, 10);
+                    stage->buckets++;
+                }
+            } else if (strncmp(line + 26, "sum", 3) == 0) {
+                metrics->stages[s].sum = strtod(brace + 1, NULL);
+            } else if (strncmp(line + 26, "count", 5) == 0) {
+                metrics->stages[s].count = strtoull(brace + 1, NULL, 10);
+            }
+        }
+    }
+    
+    metrics->valid = true;
+    return true;
+}
+
+/* Upper bound of the bucket a percentile of a stage's new values falls in, in microseconds;
+ * -1 if it is beyond the last finite bucket */
+static double replay_percentile(const replay_stage_t *before, const replay_stage_t *after, double percentile) {
+    uint64_t total = after->count - before->count;
+    uint64_t rank = (uint64_t)(percentile / 100.0 * total + 0.999999);
+    int i;
+    
+    for (i = 0; i < after->buckets && i < before->buckets; i++) {
+        if (after->cumulative[i] - before->cumulative[i] >= rank) {
+            return after->le[i] < 0 ? -1.0 : after->le[i] * 1e6;
+        }
+    }
+    return -1.0;
+}
+
+/* Print a percentile, or the last finite bucket it exceeds */
+static void replay_print_bound(const char *name, double value) {
+    if (value < 0) {
+        printf(" %s=inf", name);
+    } else {
+        printf(" %s<=%.1f", name, value);
+    }
+}
+
+/* Report what the server measured during the replay */
+static void replay_report_metrics(const replay_metrics_t *before, const replay_metrics_t *after) {
+    int s, r;
+    
+    printf("Server: %llu packets received, %llu relayed, %d clients\n",
+           (unsigned long long)(after->received - before->received),
+           (unsigned long long)(after->relayed - before->relayed), after->clients);
+    
+    printf("Server errors:");
+    for (r = 0; r < after->reason_count; r++) {
+        uint64_t earlier = r < before->reason_count ? before->errors[r] : 0;
+        printf(" %s=%llu", after->reasons[r], (unsigned long long)(after->errors[r] - earlier));
+    }
+    printf("\n");
+    
+    for (s = 0; s < DMR_LAT_STAGES; s++) {
+        const replay_stage_t *b = &before->stages[s];
+        const replay_stage_t *a = &after->stages[s];
+        uint64_t count = a->count - b->count;
+        
+        printf("Stage %-18s %10llu frames", stage_names[s], (unsigned long long)count);
+        if (count > 0) {
+            printf("  mean=%.1f us", (a->sum - b->sum) / count * 1e6);
+            replay_print_bound("p50", replay_percentile(b, a, 50.0));
+            replay_print_bound("p99", replay_percentile(b, a, 99.0));
+            replay_print_bound("p99.9", replay_percentile(b, a, 99.9));
+            printf(" us");
+        }
+        printf("\n");
+    }
+}
+
+/* Receive and discard whatever the server relayed back to the replay sockets */
+static void replay_drain(int timeout_ms) {
+    uint8_t buffer[DMR_BUFFER_SIZE];
+    int i;
+    
+    if (poll(sockets, source_count, timeout_ms) <= 0) {
+        return;
+    }
+    for (i = 0; i < source_count; i++) {
+        if (sockets[i].revents & POLLIN) {
+            while (recv(sockets[i].fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+                relayed_back++;
+            }
+        }
+    }
+}
+
+/* Send every datagram with the chosen timing */
+static int replay_send(struct sockaddr_in *server, int mode, double speed) {
+    uint64_t start = dmr_stats_clock();
+    uint64_t first = packet_count > 0 ? packets[0].time : 0;
+    size_t i;
+    
+    for (i = 0; i < packet_count; i++) {
+        replay_packet_t *packet = &packets[i];
+        
+        if (mode != REPLAY_MAX_RATE) {
+            /* Captures are not always in time order; never wait for an earlier packet */
+            uint64_t offset = packet->time > first ? packet->time - first : 0;
+            uint64_t due = start + (uint64_t)(offset / (mode == REPLAY_SPEEDUP ? speed : 1.0));
+            uint64_t now = dmr_stats_clock();
+            
+            while (now < due) {
+                replay_drain((int)((due - now) / 1000000));
+                now = dmr_stats_clock();
+            }
+        } else if (i % REPLAY_DRAIN_EVERY == 0) {
+            replay_drain(0);
+        }
+        
+        if (sendto(sockets[packet->source].fd, packet->data, packet->length, 0,
+                   (struct sockaddr *)server, sizeof(*server)) < 0) {
+            perror("sendto");
+        }
+    }
+    
+    return 0;
+}
+
+/* Read a whole file */
+static uint8_t *replay_load(const char *path, size_t *size) {
+    FILE *fp = fopen(path, "rb");
+    uint8_t *data;
+    long length;
+    
+    if (fp == NULL) {
+        perror(path);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    
+    data = length > 0 ? malloc((size_t)length) : NULL;
+    if (data == NULL || fread(data, 1, (size_t)length, fp) != (size_t)length) {
+        fprintf(stderr, "Failed to read %s\n", path);
+        free(data);
+        fclose(fp);
+        return NULL;
+    }
+    
+    fclose(fp);
+    *size = (size_t)length;
+    return data;
+}
+
+/* Print usage */
+static void replay_usage(const char *program_name) {
+    printf("Usage: %s [options] CAPTURE\n", program_name);
+    printf("Options:\n");
+    printf("  -s ADDR     Server address (default: 127.0.0.1)\n");
+    printf("  -p PORT     Server port (default: %d)\n", DMR_SERVER_PORT);
+    printf("  -P PORT     Destination port to take from the capture (default: %d)\n", DMR_SERVER_PORT);
+    printf("  -m MODE     Timing: original, speedup or max (default: original)\n");
+    printf("  -x FACTOR   Speed-up factor for -m speedup (default: 10)\n");
+    printf("  -M PORT     Server metrics port for per-stage timing, 0 disables (default: 0)\n");
+    printf("  -h          Print this help message\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *host = "127.0.0.1";
+    const char *path = NULL;
+    uint16_t port = DMR_SERVER_PORT;
+    int mode = REPLAY_ORIGINAL;
+    double speed = 10.0;
+    int metrics_port = 0;
+    struct sockaddr_in server;
+    static replay_metrics_t before, after;
+    char *response;
+    uint8_t *capture;
+    size_t size;
+    uint64_t started, elapsed;
+    uint32_t magic;
+    int i;
+    
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            host = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+            filter_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "original") == 0) {
+                mode = REPLAY_ORIGINAL;
+            } else if (strcmp(argv[i], "speedup") == 0) {
+                mode = REPLAY_SPEEDUP;
+            } else if (strcmp(argv[i], "max") == 0) {
+                mode = REPLAY_MAX_RATE;
+            } else {
+                fprintf(stderr, "Unknown timing mode: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc) {
+            metrics_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-h") == 0) {
+            replay_usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            replay_usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (path == NULL || speed <= 0) {
+        replay_usage(argv[0]);
+        return 1;
+    }
+    
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &server.sin_addr) <= 0) {
+        fprintf(stderr, "Invalid server address: %s\n", host);
+        return 1;
+    }
+    
+    /* Extract the datagrams to replay */
+    capture = replay_load(path, &size);
+    if (capture == NULL) {
+        return 1;
+    }
+    memset(source_buckets, 0xFF, sizeof(source_buckets));
+    magic = size >= 24 ? replay_u32(capture, false) : 0;
+    if (magic == 0xA1B2C3D4 || magic == 0xD4C3B2A1 || magic == 0xA1B23C4D || magic == 0x4D3CB2A1) {
+        replay_read_pcap(capture, size);
+    } else if (magic == 0x0A0D0D0A) {
+        replay_read_pcapng(capture, size);
+    } else {
+        fprintf(stderr, "%s is not a pcap or pcapng capture\n", path);
+        return 1;
+    }
+    printf("Capture: %lu datagrams to port %d from %d sources, %llu other frames skipped\n",
+           (unsigned long)packet_count, filter_port, source_count, (unsigned long long)skipped);
+    if (packet_count == 0) {
+        return 1;
+    }
+    
+    /* One socket per captured source */
+    sockets = calloc(source_count, sizeof(struct pollfd));
+    if (sockets == NULL) {
+        return 1;
+    }
+    for (i = 0; i < source_count; i++) {
+        sockets[i].fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        sockets[i].events = POLLIN;
+        if (sockets[i].fd < 0) {
+            perror("socket (raise the open file limit for large captures)");
+            return 1;
+        }
+    }
+    
+    response = malloc(REPLAY_SCRAPE_SIZE);
+    if (response == NULL) {
+        return 1;
+    }
+    if (metrics_port > 0 && !replay_scrape(host, metrics_port, &before, response)) {
+        fprintf(stderr, "Warning: no metrics at %s:%d, per-stage timing disabled\n", host, metrics_port);
+    }
+    
+    started = dmr_stats_clock();
+    replay_send(&server, mode, speed);
+    elapsed = dmr_stats_clock() - started;
+    replay_drain(REPLAY_DRAIN_MS);
+    
+    printf("Replayed %lu datagrams in %.3f s (%.1f/s), %llu relayed back\n", (unsigned long)packet_count,
+           elapsed / 1e9, packet_count / (elapsed / 1e9), (unsigned long long)relayed_back);
+    
+    if (before.valid && replay_scrape(host, metrics_port, &after, response)) {
+        replay_report_metrics(&before, &after);
+    }
+    
+    for (i = 0; i < source_count; i++) {
+        close(sockets[i].fd);
+    }
+    free(sockets);
+    free(response);
+    free(packets);
+    free(capture);
+    return 0;
+}
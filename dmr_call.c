@@ -0,0 +1,102 @@
+/*
+ * DMR Voice Relay Server - Call Tracking
+ *
+ * This file contains the per-slot call state machine. Each repeater keeps
+ * one dmr_call_t per time slot, so classifying a frame is a single state
+ * lookup: voice and data frames start a call on a free slot and continue
+ * it while source and destination match, and a control frame from the
+ * same stream is its terminator. After a call the slot hangs, reserved for
+ * replies to the same destination, for the hang time. A call whose
+ * terminator never arrives is ended once it has been silent for the call
+ * timeout. The server drives both expiries from a timer per call, which it
+ * moves on lazily like the client timeouts; a frame arriving first applies
+ * them on the spot.
+ *
+ * Copyright (c) 2025
+ */
+
+#include "dmr_server.h"
+
+/* Move a call on by the time elapsed since its last frame; returns true
+ * if an active call was lost. Other workers' clocks may run slightly ahead
+ * of the caller's, so a frame newer than now counts as just heard. */
+bool dmr_call_expire(dmr_call_t *call, uint64_t now, uint32_t timeout_ms, uint32_t hang_ms) {
+    bool lost = false;
+
+    if (now <= call->last_frame) {
+        return false;
+    }
+    if (call->state == DMR_CALL_ACTIVE && now - call->last_frame > timeout_ms) {
+        call->state = DMR_CALL_HANG;
+        lost = true;
+    }
+    if (call->state == DMR_CALL_HANG && now - call->last_frame > hang_ms) {
+        call->state = DMR_CALL_IDLE;
+    }
+
+    return lost;
+}
+
+/* Time in monotonic ms after which the call changes state by itself, 0 when idle */
+uint64_t dmr_call_deadline(const dmr_call_t *call, uint32_t timeout_ms, uint32_t hang_ms) {
+    switch (call->state) {
+    case DMR_CALL_ACTIVE:
+        return call->last_frame + timeout_ms;
+    case DMR_CALL_HANG:
+        return call->last_frame + hang_ms;
+    default:
+        return 0;
+    }
+}
+
+/* Begin a new call on a slot */
+static int dmr_call_start(dmr_call_t *call, uint32_t src_id, uint32_t dst_id, uint64_t now) {
+    call->state = DMR_CALL_ACTIVE;
+    call->src_id = src_id;
+    call->dst_id = dst_id;
+    call->started = now;
+    call->last_frame = now;
+    return DMR_CALL_START;
+}
+
+/* Classify a frame against its slot's call and advance the call; lost is
+ * set if the slot's previous call timed out without a terminator */
+int dmr_call_classify(dmr_call_t *call, uint8_t type, uint32_t src_id, uint32_t dst_id,
+                      uint64_t now, uint32_t timeout_ms, uint32_t hang_ms, bool *lost) {
+    bool same_stream;
+
+    *lost = dmr_call_expire(call, now, timeout_ms, hang_ms);
+    same_stream = call->src_id == src_id && call->dst_id == dst_id;
+
+    /* A control frame only matters as the terminator of the slot's call */
+    if (type == DMR_PKT_CONTROL) {
+        if (call->state == DMR_CALL_ACTIVE && same_stream) {
+            call->state = DMR_CALL_HANG;
+            call->last_frame = now;
+            return DMR_CALL_END;
+        }
+        return DMR_CALL_NONE;
+    }
+    if (type != DMR_PKT_VOICE && type != DMR_PKT_DATA) {
+        return DMR_CALL_NONE;
+    }
+
+    switch (call->state) {
+    case DMR_CALL_ACTIVE:
+        if (!same_stream) {
+            return DMR_CALL_CONFLICT;
+        }
+        call->last_frame = now;
+        return DMR_CALL_CONTINUE;
+
+    case DMR_CALL_HANG:
+        /* Anyone may answer on the same destination while the slot hangs */
+        if (dst_id != call->dst_id) {
+            return DMR_CALL_CONFLICT;
+        }
+        return dmr_call_start(call, src_id, dst_id, now);
+
+    default:
+        return dmr_call_start(call, src_id, dst_id, now);
+    }
+}
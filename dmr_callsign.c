@@ -0,0 +1,194 @@
+/*
+ * DMR Voice Relay Server - Callsign Cache
+ * 
+ * This file contains the in-memory DMR ID to callsign cache. It is bulk
+ * loaded from dmr_clients at startup and refreshed by the database writer,
+ * so resolving a callsign on the packet path is a single hash probe that
+ * never waits for MariaDB. DMR IDs the database does not know are cached
+ * too, for a limited time, so they are not looked up on every connect.
+ * The cache has a fixed number of entries; when it is full the CLOCK
+ * algorithm picks an entry that has not been used recently to replace.
+ * 
+ * Copyright (c) 2025
+ */
+
+#include "dmr_server.h"
+
+/* Cache entry */
+typedef struct {
+    uint32_t dmr_id;                    /* DMR ID */
+    uint8_t referenced;                 /* CLOCK reference bit */
+    char callsign[10];                  /* Callsign, empty for a negative entry */
+    uint64_t expires;                   /* Expiry of a negative entry, monotonic ms */
+} dmr_callsign_entry_t;
+
+/* Global variables */
+static dmr_callsign_entry_t *entries = NULL;
+static uint32_t entry_count = 0;
+static uint32_t entry_capacity = 0;
+static uint32_t clock_hand = 0;
+static int negative_ttl = DMR_CALLSIGN_NEGATIVE_TTL;
+static dmr_index_t entry_index;         /* DMR ID -> entry */
+static dmr_rwlock_t cache_lock = DMR_RWLOCK_INITIALIZER;
+static uint64_t cache_hits = 0;
+static uint64_t cache_negative_hits = 0;
+static uint64_t cache_misses = 0;
+static uint64_t cache_evictions = 0;
+
+/* Pick an entry for a new DMR ID, evicting one if the cache is full */
+static uint32_t dmr_callsign_victim(void) {
+    dmr_callsign_entry_t *entry;
+    uint32_t index;
+    
+    if (entry_count < entry_capacity) {
+        index = entry_count;
+        __atomic_store_n(&entry_count, index + 1, __ATOMIC_RELAXED);
+        return index;
+    }
+    
+    /* Sweep, giving referenced entries a second chance */
+    for (;;) {
+        index = clock_hand;
+        entry = &entries[index];
+        clock_hand = (clock_hand + 1) % entry_capacity;
+        
+        if (entry->referenced) {
+            entry->referenced = 0;
+            continue;
+        }
+        
+        dmr_index_remove(&entry_index, entry->dmr_id, index);
+        DMR_COUNTER_ADD(cache_evictions, 1);
+        return index;
+    }
+}
+
+/* Allocate the cache */
+int dmr_callsign_init(int capacity, int ttl) {
+    uint32_t buckets = DMR_INDEX_MIN_BUCKETS;
+    
+    entry_capacity = capacity > 0 ? (uint32_t)capacity : DMR_CALLSIGN_CACHE_SIZE;
+    negative_ttl = ttl >= 0 ? ttl : DMR_CALLSIGN_NEGATIVE_TTL;
+    
+    /* Size the index so a full cache never needs to grow it */
+    while (buckets < entry_capacity * 2) {
+        buckets <<= 1;
+    }
+    
+    entries = calloc(entry_capacity, sizeof(dmr_callsign_entry_t));
+    if (entries == NULL || dmr_index_init(&entry_index, buckets) != 0) {
+        fprintf(stderr, "Failed to allocate callsign cache\n");
+        free(entries);
+        entries = NULL;
+        return -1;
+    }
+    
+    entry_count = 0;
+    clock_hand = 0;
+    return 0;
+}
+
+/* Release the cache */
+void dmr_callsign_cleanup(void) {
+    dmr_rwlock_wrlock(&cache_lock);
+    free(entries);
+    free(entry_index.buckets);
+    entries = NULL;
+    entry_count = 0;
+    entry_capacity = 0;
+    memset(&entry_index, 0, sizeof(entry_index));
+    dmr_rwlock_wrunlock(&cache_lock);
+}
+
+/* Look a DMR ID up, copying the callsign on DMR_CALLSIGN_HIT */
+int dmr_callsign_lookup(uint32_t dmr_id, char *callsign, size_t size, uint64_t now) {
+    dmr_callsign_entry_t *entry;
+    uint32_t index;
+    int result = DMR_CALLSIGN_MISS;
+    
+    if (dmr_id == 0 || size == 0) {
+        return DMR_CALLSIGN_MISS;
+    }
+    
+    dmr_rwlock_rdlock(&cache_lock);
+    
+    if (entries != NULL) {
+        index = dmr_index_find(&entry_index, dmr_id);
+        if (index != DMR_INDEX_EMPTY) {
+            entry = &entries[index];
+            __atomic_store_n(&entry->referenced, 1, __ATOMIC_RELAXED);
+            
+            if (entry->callsign[0] != '\0') {
+                strncpy(callsign, entry->callsign, size - 1);
+                callsign[size - 1] = '\0';
+                result = DMR_CALLSIGN_HIT;
+            } else if (entry->expires > now) {
+                result = DMR_CALLSIGN_NEGATIVE;
+            }
+        }
+    }
+    
+    dmr_rwlock_rdunlock(&cache_lock);
+    
+    if (result == DMR_CALLSIGN_HIT) {
+        DMR_COUNTER_ADD(cache_hits, 1);
+    } else if (result == DMR_CALLSIGN_NEGATIVE) {
+        DMR_COUNTER_ADD(cache_negative_hits, 1);
+    } else {
+        DMR_COUNTER_ADD(cache_misses, 1);
+    }
+    
+    return result;
+}
+
+/* Cache a callsign; NULL or empty caches the DMR ID as unknown */
+void dmr_callsign_store(uint32_t dmr_id, const char *callsign, uint64_t now) {
+    dmr_callsign_entry_t *entry;
+    uint32_t index;
+    
+    if (dmr_id == 0) {
+        return;
+    }
+    
+    /* dmr_db_log_client() records clients without a callsign as "Unknown" */
+    if (callsign != NULL && strcmp(callsign, "Unknown") == 0) {
+        callsign = NULL;
+    }
+    
+    dmr_rwlock_wrlock(&cache_lock);
+    
+    if (entries == NULL) {
+        dmr_rwlock_wrunlock(&cache_lock);
+        return;
+    }
+    
+    /* New entries start unreferenced, only a lookup earns a second chance */
+    index = dmr_index_find(&entry_index, dmr_id);
+    if (index == DMR_INDEX_EMPTY) {
+        index = dmr_callsign_victim();
+        dmr_index_put(&entry_index, dmr_id, index);
+        entries[index].referenced = 0;
+    }
+    
+    entry = &entries[index];
+    entry->dmr_id = dmr_id;
+    if (callsign != NULL) {
+        strncpy(entry->callsign, callsign, sizeof(entry->callsign) - 1);
+        entry->callsign[sizeof(entry->callsign) - 1] = '\0';
+    } else {
+        entry->callsign[0] = '\0';
+    }
+    entry->expires = now + (uint64_t)negative_ttl * 1000;
+    
+    dmr_rwlock_wrunlock(&cache_lock);
+}
+
+/* Copy the cache statistics without taking the cache lock */
+void dmr_callsign_stats(dmr_callsign_stats_t *stats) {
+    stats->entries = DMR_COUNTER_LOAD(entry_count);
+    stats->capacity = DMR_COUNTER_LOAD(entry_capacity);
+    stats->hits = DMR_COUNTER_LOAD(cache_hits);
+    stats->negative_hits = DMR_COUNTER_LOAD(cache_negative_hits);
+    stats->misses = DMR_COUNTER_LOAD(cache_misses);
+    stats->evictions = DMR_COUNTER_LOAD(cache_evictions);
+}
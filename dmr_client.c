@@ -0,0 +1,361 @@
+/*
+ * DMR Voice Relay Server - Client Registry
+ * 
+ * This file contains the client registry: clients live in fixed-size pages
+ * so their addresses never move, and two open-addressing hash indexes map
+ * (IPv4 address, port) and DMR ID to a storage slot. The addresses of the
+ * active clients are also kept packed in a dense array for the relay loop.
+ * The hash index itself is shared with the other lookup tables.
+ * All functions expect the caller to hold the server's client lock.
+ * 
+ * Copyright (c) 2025
+ */
+
+#include "dmr_server.h"
+
+/* Global variables */
+static dmr_client_t **pages = NULL;     /* Client storage pages */
+static uint32_t page_count = 0;
+static uint32_t *free_slots = NULL;     /* Stack of unused storage slots */
+static uint32_t free_count = 0;
+static uint32_t client_total = 0;       /* Registered clients */
+static uint32_t client_limit = DMR_MAX_CLIENTS;
+static dmr_index_t addr_index;          /* (IPv4, port) -> slot */
+static dmr_index_t id_index;            /* DMR ID -> slot */
+static struct sockaddr_in *peer_addrs = NULL;  /* Active client addresses, packed */
+static uint32_t *peer_slots = NULL;     /* Storage slot of each packed address */
+static uint32_t peer_capacity = 0;
+
+/* Build the address index key */
+static uint64_t dmr_addr_key(const struct sockaddr_in *addr) {
+    return ((uint64_t)addr->sin_addr.s_addr << 16) | addr->sin_port;
+}
+
+/* Map a key to its home bucket */
+static uint32_t dmr_index_home(const dmr_index_t *index, uint64_t key) {
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & index->mask;
+}
+
+/* Allocate an empty index */
+int dmr_index_init(dmr_index_t *index, uint32_t buckets) {
+    uint32_t i;
+    
+    index->buckets = malloc(buckets * sizeof(dmr_index_entry_t));
+    if (index->buckets == NULL) {
+        return -1;
+    }
+    
+    for (i = 0; i < buckets; i++) {
+        index->buckets[i].slot = DMR_INDEX_EMPTY;
+    }
+    index->mask = buckets - 1;
+    index->count = 0;
+    
+    return 0;
+}
+
+/* Find the slot stored for a key */
+uint32_t dmr_index_find(const dmr_index_t *index, uint64_t key) {
+    uint32_t pos = dmr_index_home(index, key);
+    
+    while (index->buckets[pos].slot != DMR_INDEX_EMPTY) {
+        if (index->buckets[pos].key == key) {
+            return index->buckets[pos].slot;
+        }
+        pos = (pos + 1) & index->mask;
+    }
+    
+    return DMR_INDEX_EMPTY;
+}
+
+/* Store a key, replacing any previous slot; the index must have room */
+void dmr_index_put(dmr_index_t *index, uint64_t key, uint32_t slot) {
+    uint32_t pos = dmr_index_home(index, key);
+    
+    while (index->buckets[pos].slot != DMR_INDEX_EMPTY) {
+        if (index->buckets[pos].key == key) {
+            index->buckets[pos].slot = slot;
+            return;
+        }
+        pos = (pos + 1) & index->mask;
+    }
+    
+    index->buckets[pos].key = key;
+    index->buckets[pos].slot = slot;
+    index->count++;
+}
+
+/* Double the index once it is half full */
+int dmr_index_reserve(dmr_index_t *index) {
+    dmr_index_t grown;
+    uint32_t i;
+    
+    if ((index->count + 1) * 2 <= index->mask + 1) {
+        return 0;
+    }
+    
+    if (dmr_index_init(&grown, (index->mask + 1) * 2) != 0) {
+        return -1;
+    }
+    
+    for (i = 0; i <= index->mask; i++) {
+        if (index->buckets[i].slot != DMR_INDEX_EMPTY) {
+            dmr_index_put(&grown, index->buckets[i].key, index->buckets[i].slot);
+        }
+    }
+    
+    free(index->buckets);
+    *index = grown;
+    return 0;
+}
+
+/* Remove a key if it maps to the given slot, shifting later entries back */
+void dmr_index_remove(dmr_index_t *index, uint64_t key, uint32_t slot) {
+    uint32_t pos = dmr_index_home(index, key);
+    uint32_t next;
+    
+    while (index->buckets[pos].slot != DMR_INDEX_EMPTY) {
+        if (index->buckets[pos].key == key) {
+            break;
+        }
+        pos = (pos + 1) & index->mask;
+    }
+    
+    if (index->buckets[pos].slot != slot) {
+        return;
+    }
+    
+    /* Backward-shift deletion keeps probe chains intact without tombstones */
+    next = (pos + 1) & index->mask;
+    while (index->buckets[next].slot != DMR_INDEX_EMPTY) {
+        uint32_t home = dmr_index_home(index, index->buckets[next].key);
+        
+        /* Move the entry back unless its home lies in (pos, next] */
+        if (((next - home) & index->mask) >= ((next - pos) & index->mask)) {
+            index->buckets[pos] = index->buckets[next];
+            pos = next;
+        }
+        next = (next + 1) & index->mask;
+    }
+    
+    index->buckets[pos].slot = DMR_INDEX_EMPTY;
+    index->count--;
+}
+
+/* Add a storage page and put its slots on the free stack */
+static int dmr_clients_add_page(void) {
+    dmr_client_t **new_pages;
+    uint32_t *new_free;
+    dmr_client_t *page;
+    uint32_t base = page_count * DMR_CLIENT_PAGE_SIZE;
+    uint32_t i;
+    
+    new_pages = realloc(pages, (page_count + 1) * sizeof(dmr_client_t *));
+    if (new_pages == NULL) {
+        return -1;
+    }
+    pages = new_pages;
+    
+    new_free = realloc(free_slots, (base + DMR_CLIENT_PAGE_SIZE) * sizeof(uint32_t));
+    if (new_free == NULL) {
+        return -1;
+    }
+    free_slots = new_free;
+    
+    page = calloc(DMR_CLIENT_PAGE_SIZE, sizeof(dmr_client_t));
+    if (page == NULL) {
+        return -1;
+    }
+    pages[page_count++] = page;
+    
+    /* Push in reverse so low slots are handed out first */
+    for (i = DMR_CLIENT_PAGE_SIZE; i > 0; i--) {
+        page[i - 1].slot = base + i - 1;
+        free_slots[free_count++] = base + i - 1;
+    }
+    
+    return 0;
+}
+
+/* Make room for one more packed peer address */
+static int dmr_peers_reserve(void) {
+    struct sockaddr_in *new_addrs;
+    uint32_t *new_slots;
+    uint32_t capacity;
+    
+    if (client_total < peer_capacity) {
+        return 0;
+    }
+    
+    capacity = peer_capacity ? peer_capacity * 2 : DMR_CLIENT_PAGE_SIZE;
+    
+    new_addrs = realloc(peer_addrs, capacity * sizeof(struct sockaddr_in));
+    if (new_addrs == NULL) {
+        return -1;
+    }
+    peer_addrs = new_addrs;
+    
+    new_slots = realloc(peer_slots, capacity * sizeof(uint32_t));
+    if (new_slots == NULL) {
+        return -1;
+    }
+    peer_slots = new_slots;
+    
+    peer_capacity = capacity;
+    return 0;
+}
+
+/* Initialize the client registry */
+int dmr_clients_init(int max_clients) {
+    client_limit = max_clients > 0 ? (uint32_t)max_clients : DMR_MAX_CLIENTS;
+    
+    if (dmr_index_init(&addr_index, DMR_INDEX_MIN_BUCKETS) != 0 ||
+        dmr_index_init(&id_index, DMR_INDEX_MIN_BUCKETS) != 0) {
+        fprintf(stderr, "Failed to allocate client index\n");
+        dmr_clients_cleanup();
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* Release the client registry */
+void dmr_clients_cleanup(void) {
+    uint32_t i;
+    
+    for (i = 0; i < page_count; i++) {
+        free(pages[i]);
+    }
+    free(pages);
+    free(free_slots);
+    free(addr_index.buckets);
+    free(id_index.buckets);
+    free(peer_addrs);
+    free(peer_slots);
+    
+    pages = NULL;
+    page_count = 0;
+    free_slots = NULL;
+    free_count = 0;
+    client_total = 0;
+    peer_addrs = NULL;
+    peer_slots = NULL;
+    peer_capacity = 0;
+    memset(&addr_index, 0, sizeof(addr_index));
+    memset(&id_index, 0, sizeof(id_index));
+}
+
+/* Find an active client by address */
+dmr_client_t *dmr_clients_lookup(const struct sockaddr_in *addr) {
+    uint32_t slot = dmr_index_find(&addr_index, dmr_addr_key(addr));
+    
+    return slot == DMR_INDEX_EMPTY ? NULL : dmr_clients_slot(slot);
+}
+
+/* Find the most recently identified client with a DMR ID */
+dmr_client_t *dmr_clients_lookup_id(uint32_t dmr_id) {
+    uint32_t slot;
+    
+    if (dmr_id == 0) {
+        return NULL;
+    }
+    
+    slot = dmr_index_find(&id_index, dmr_id);
+    return slot == DMR_INDEX_EMPTY ? NULL : dmr_clients_slot(slot);
+}
+
+/* Register a new client; returns NULL when full or out of memory */
+dmr_client_t *dmr_clients_insert(const struct sockaddr_in *addr) {
+    dmr_client_t *client;
+    uint32_t slot;
+    
+    if (client_total >= client_limit) {
+        return NULL;
+    }
+    
+    if (free_count == 0 && dmr_clients_add_page() != 0) {
+        return NULL;
+    }
+    
+    /* Make room in both indexes and the peer list before touching anything */
+    if (dmr_index_reserve(&addr_index) != 0 || dmr_index_reserve(&id_index) != 0 ||
+        dmr_peers_reserve() != 0) {
+        return NULL;
+    }
+    
+    slot = free_slots[--free_count];
+    client = dmr_clients_slot(slot);
+    memset(client, 0, sizeof(*client));
+    client->slot = slot;
+    memcpy(&client->addr, addr, sizeof(struct sockaddr_in));
+    client->active = true;
+    
+    dmr_index_put(&addr_index, dmr_addr_key(addr), slot);
+    
+    /* Append to the packed peer list */
+    client->peer_index = client_total;
+    peer_addrs[client_total] = client->addr;
+    peer_slots[client_total] = slot;
+    client_total++;
+    
+    return client;
+}
+
+/* Set a client's DMR ID and index it */
+void dmr_clients_set_id(dmr_client_t *client, uint32_t dmr_id) {
+    if (client->dmr_id != 0) {
+        dmr_index_remove(&id_index, client->dmr_id, client->slot);
+    }
+    
+    client->dmr_id = dmr_id;
+    
+    if (dmr_id != 0) {
+        dmr_index_put(&id_index, dmr_id, client->slot);
+    }
+}
+
+/* Unregister a client and recycle its slot */
+void dmr_clients_erase(dmr_client_t *client) {
+    if (!client->active) {
+        return;
+    }
+    
+    dmr_index_remove(&addr_index, dmr_addr_key(&client->addr), client->slot);
+    if (client->dmr_id != 0) {
+        dmr_index_remove(&id_index, client->dmr_id, client->slot);
+    }
+    
+    /* Fill the hole in the packed peer list with the last entry */
+    client_total--;
+    if (client->peer_index != client_total) {
+        uint32_t moved = peer_slots[client_total];
+        
+        peer_addrs[client->peer_index] = peer_addrs[client_total];
+        peer_slots[client->peer_index] = moved;
+        dmr_clients_slot(moved)->peer_index = client->peer_index;
+    }
+    
+    client->active = false;
+    free_slots[free_count++] = client->slot;
+}
+
+/* Number of registered clients */
+int dmr_clients_count(void) {
+    return (int)client_total;
+}
+
+/* Packed addresses of every active client */
+const struct sockaddr_in *dmr_clients_peers(int *count) {
+    *count = (int)client_total;
+    return peer_addrs;
+}
+
+/* Number of storage slots, active or not */
+int dmr_clients_capacity(void) {
+    return (int)(page_count * DMR_CLIENT_PAGE_SIZE);
+}
+
+/* Storage slot by index */
+dmr_client_t *dmr_clients_slot(uint32_t slot) {
+    return &pages[slot / DMR_CLIENT_PAGE_SIZE][slot % DMR_CLIENT_PAGE_SIZE];
+}
@@ -2,6 +2,12 @@
  * DMR Voice Relay Server - Database Module
  * 
  * This file contains the database functionality for the DMR voice relay server.
+ * Every query is a prepared statement, prepared once when the connection is
+ * opened and bound to fixed parameter buffers, so a call only fills in the
+ * buffers and executes. Frame rows are buffered and written as one multi-row
+ * INSERT per transaction, either once a batch is full or once its oldest row
+ * has waited long enough. A partial batch is split into power-of-two runs,
+ * each written by a multi-row INSERT of that size prepared on first use.
  * 
  * Copyright (c) 2025
  */
@@ -12,9 +18,307 @@
 static MYSQL *mysql_conn = NULL;
 static bool db_enabled = false;
 static char db_error_message[1024];
+static dmr_mutex_t db_lock = DMR_MUTEX_INITIALIZER;  /* One connection, shared by all workers */
+
+/* Buffered dmr_frames row, also the bound parameters of one VALUES tuple */
+typedef struct {
+    uint64_t timestamp;                 /* Time the frame was received */
+    uint8_t type;                       /* Frame type */
+    uint8_t slot;                       /* Time slot */
+    uint16_t client_port;               /* Client port */
+    uint32_t src_id;                    /* Source DMR ID */
+    uint32_t dst_id;                    /* Destination DMR ID */
+    char client_ip[INET_ADDRSTRLEN];    /* Client IP address */
+    unsigned long client_ip_length;     /* Length of client_ip */
+} dmr_db_frame_row_t;
+
+/* Parameters per dmr_frames row; a batch must stay under 65535 placeholders */
+#define DMR_DB_FRAME_PARAMS     7
+#define DMR_DB_MAX_BATCH_ROWS   4096
+#define DMR_DB_PART_SIZES       12      /* Partial INSERTs of 1 to 2048 rows */
+
+/* Frame batch state */
+static dmr_db_frame_row_t *frame_rows = NULL;
+static MYSQL_BIND *frame_binds = NULL;    /* Parameters of every buffered row, in order */
+static int frame_row_count = 0;
+static int frame_batch_rows = DMR_DB_BATCH_ROWS;
+static int frame_flush_ms = DMR_DB_FLUSH_MS;
+static uint64_t frame_batch_started = 0;  /* Microseconds, when the first row was buffered */
+static dmr_db_frame_row_t frame_single;   /* Parameters of the single-row INSERT */
+static dmr_db_flush_stats_t flush_stats;
+
+/* Parameters shared by the client statements */
+static struct {
+    char event[32];                     /* Event name */
+    unsigned long event_length;
+    uint32_t dmr_id;                    /* Client DMR ID */
+    char callsign[11];                  /* Client callsign */
+    unsigned long callsign_length;
+    char client_ip[INET_ADDRSTRLEN];    /* Client IP address */
+    unsigned long client_ip_length;
+    uint16_t client_port;               /* Client port */
+} client_params;
+
+/* Callsign query parameters and results */
+static uint32_t callsign_dmr_id;
+static uint32_t callsign_window;        /* Seconds of last_seen to load, 0 for all */
+static char callsign_result[11];
+static unsigned long callsign_result_length;
+static my_bool callsign_result_null;
+
+/* Prepared statements */
+static MYSQL_STMT *frame_batch_stmt = NULL;    /* INSERT of a full frame batch */
+static MYSQL_STMT *frame_part_stmts[DMR_DB_PART_SIZES];  /* INSERT of 2^i frame rows, or NULL */
+static MYSQL_STMT *frame_stmt = NULL;          /* INSERT of one frame row */
+static MYSQL_STMT *event_stmt = NULL;          /* INSERT into dmr_events */
+static MYSQL_STMT *client_find_stmt = NULL;    /* SELECT a client row by address */
+static MYSQL_STMT *client_update_stmt = NULL;  /* UPDATE a connected client */
+static MYSQL_STMT *client_insert_stmt = NULL;  /* INSERT a new client */
+static MYSQL_STMT *client_inactive_stmt = NULL;  /* UPDATE a departed client */
+static MYSQL_STMT *callsign_stmt = NULL;       /* SELECT a callsign by DMR ID */
+static MYSQL_STMT *callsign_load_stmt = NULL;  /* SELECT recently seen callsigns */
+static bool statements_stale = false;          /* A statement failed, prepare again */
+
+/* Point a bind at a fixed buffer */
+static void dmr_db_bind(MYSQL_BIND *bind, enum enum_field_types type, void *buffer,
+                        unsigned long buffer_length, unsigned long *length) {
+    memset(bind, 0, sizeof(*bind));
+    bind->buffer_type = type;
+    bind->buffer = buffer;
+    bind->buffer_length = buffer_length;
+    bind->length = length;
+    bind->is_unsigned = 1;
+}
+
+/* Bind the parameters of one dmr_frames VALUES tuple to a row */
+static void dmr_db_bind_frame_row(MYSQL_BIND *bind, dmr_db_frame_row_t *row) {
+    dmr_db_bind(&bind[0], MYSQL_TYPE_LONGLONG, &row->timestamp, 0, NULL);
+    dmr_db_bind(&bind[1], MYSQL_TYPE_TINY, &row->type, 0, NULL);
+    dmr_db_bind(&bind[2], MYSQL_TYPE_TINY, &row->slot, 0, NULL);
+    dmr_db_bind(&bind[3], MYSQL_TYPE_LONG, &row->src_id, 0, NULL);
+    dmr_db_bind(&bind[4], MYSQL_TYPE_LONG, &row->dst_id, 0, NULL);
+    dmr_db_bind(&bind[5], MYSQL_TYPE_STRING, row->client_ip, sizeof(row->client_ip),
+                &row->client_ip_length);
+    dmr_db_bind(&bind[6], MYSQL_TYPE_SHORT, &row->client_port, 0, NULL);
+}
+
+/* Fill the address fields of a frame row */
+static void dmr_db_set_frame_addr(dmr_db_frame_row_t *row, struct sockaddr_in *client_addr) {
+    inet_ntop(AF_INET, &client_addr->sin_addr, row->client_ip, INET_ADDRSTRLEN);
+    row->client_ip_length = strlen(row->client_ip);
+    row->client_port = ntohs(client_addr->sin_port);
+}
+
+/* Prepare a statement and bind its parameters */
+static MYSQL_STMT *dmr_db_prepare(const char *sql, MYSQL_BIND *params) {
+    MYSQL_STMT *stmt = mysql_stmt_init(mysql_conn);
+    
+    if (stmt == NULL) {
+        snprintf(db_error_message, sizeof(db_error_message), "Failed to allocate statement: %s",
+                 mysql_error(mysql_conn));
+        return NULL;
+    }
+    
+    if (mysql_stmt_prepare(stmt, sql, strlen(sql)) ||
+        (params != NULL && mysql_stmt_bind_param(stmt, params))) {
+        snprintf(db_error_message, sizeof(db_error_message), "Failed to prepare statement: %s",
+                 mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return NULL;
+    }
+    
+    return stmt;
+}
+
+/* Close a prepared statement */
+static void dmr_db_close_stmt(MYSQL_STMT **stmt) {
+    if (*stmt != NULL) {
+        mysql_stmt_close(*stmt);
+        *stmt = NULL;
+    }
+}
+
+/* Close every prepared statement */
+static void dmr_db_close_statements(void) {
+    int i;
+    
+    dmr_db_close_stmt(&frame_batch_stmt);
+    for (i = 0; i < DMR_DB_PART_SIZES; i++) {
+        dmr_db_close_stmt(&frame_part_stmts[i]);
+    }
+    dmr_db_close_stmt(&frame_stmt);
+    dmr_db_close_stmt(&event_stmt);
+    dmr_db_close_stmt(&client_find_stmt);
+    dmr_db_close_stmt(&client_update_stmt);
+    dmr_db_close_stmt(&client_insert_stmt);
+    dmr_db_close_stmt(&client_inactive_stmt);
+    dmr_db_close_stmt(&callsign_stmt);
+    dmr_db_close_stmt(&callsign_load_stmt);
+}
+
+/* Prepare a frame INSERT of a number of rows, bound to the first rows of
+ * frame_rows if bind is set; otherwise the caller binds it before each use */
+static MYSQL_STMT *dmr_db_prepare_frame_batch(int rows, bool bind) {
+    static const char *insert =
+        "INSERT INTO dmr_frames (timestamp, type, slot, src_id, dst_id, client_ip, client_port, payload_size) "
+        "VALUES ";
+    char tuple[64];
+    MYSQL_STMT *stmt;
+    size_t tuple_len, len;
+    char *sql;
+    int i;
+    
+    tuple_len = snprintf(tuple, sizeof(tuple), "(FROM_UNIXTIME(?), ?, ?, ?, ?, ?, ?, %d)",
+                         DMR_PAYLOAD_SIZE);
+    sql = malloc(strlen(insert) + (size_t)rows * (tuple_len + 2) + 1);
+    if (sql == NULL) {
+        snprintf(db_error_message, sizeof(db_error_message), "Failed to allocate frame batch statement");
+        return NULL;
+    }
+    
+    /* Build query */
+    len = strlen(insert);
+    memcpy(sql, insert, len);
+    for (i = 0; i < rows; i++) {
+        if (i > 0) {
+            sql[len++] = ',';
+            sql[len++] = ' ';
+        }
+        memcpy(sql + len, tuple, tuple_len);
+        len += tuple_len;
+    }
+    sql[len] = '\0';
+    
+    stmt = dmr_db_prepare(sql, bind ? frame_binds : NULL);
+    
+    free(sql);
+    return stmt;
+}
+
+/* Prepare every statement, caller holds db_lock or is initializing */
+static int dmr_db_prepare_statements(void) {
+    MYSQL_BIND frame_params[DMR_DB_FRAME_PARAMS];
+    MYSQL_BIND event_params[5];
+    MYSQL_BIND client_params_bind[4];
+    MYSQL_BIND addr_params[2];
+    MYSQL_BIND callsign_param;
+    MYSQL_BIND callsign_bind;
+    MYSQL_BIND load_params[2];
+    MYSQL_BIND load_binds[2];
+    char frame_sql[256];
+    
+    dmr_db_close_statements();
+    
+    /* Frame rows */
+    frame_batch_stmt = dmr_db_prepare_frame_batch(frame_batch_rows, true);
+    
+    snprintf(frame_sql, sizeof(frame_sql),
+             "INSERT INTO dmr_frames (timestamp, type, slot, src_id, dst_id, client_ip, client_port, payload_size) "
+             "VALUES (FROM_UNIXTIME(?), ?, ?, ?, ?, ?, ?, %d)", DMR_PAYLOAD_SIZE);
+    dmr_db_bind_frame_row(frame_params, &frame_single);
+    frame_stmt = dmr_db_prepare(frame_sql, frame_params);
+    
+    /* Client events */
+    dmr_db_bind(&event_params[0], MYSQL_TYPE_STRING, client_params.event,
+                sizeof(client_params.event), &client_params.event_length);
+    dmr_db_bind(&event_params[1], MYSQL_TYPE_LONG, &client_params.dmr_id, 0, NULL);
+    dmr_db_bind(&event_params[2], MYSQL_TYPE_STRING, client_params.callsign,
+                sizeof(client_params.callsign), &client_params.callsign_length);
+    dmr_db_bind(&event_params[3], MYSQL_TYPE_STRING, client_params.client_ip,
+                sizeof(client_params.client_ip), &client_params.client_ip_length);
+    dmr_db_bind(&event_params[4], MYSQL_TYPE_SHORT, &client_params.client_port, 0, NULL);
+    event_stmt = dmr_db_prepare(
+        "INSERT INTO dmr_events (timestamp, event_type, dmr_id, callsign, ip_address, port) "
+        "VALUES (NOW(), ?, ?, ?, ?, ?)", event_params);
+    
+    /* Client rows: (dmr_id, callsign, ip, port) and (ip, port) */
+    memcpy(client_params_bind, &event_params[1], sizeof(client_params_bind));
+    memcpy(addr_params, &event_params[3], sizeof(addr_params));
+    client_find_stmt = dmr_db_prepare(
+        "SELECT id FROM dmr_clients WHERE ip_address = ? AND port = ?", addr_params);
+    client_update_stmt = dmr_db_prepare(
+        "UPDATE dmr_clients SET dmr_id = ?, callsign = ?, last_seen = NOW(), active = TRUE "
+        "WHERE ip_address = ? AND port = ?", client_params_bind);
+    client_insert_stmt = dmr_db_prepare(
+        "INSERT INTO dmr_clients (dmr_id, callsign, ip_address, port, first_seen, last_seen, active) "
+        "VALUES (?, ?, ?, ?, NOW(), NOW(), TRUE)", client_params_bind);
+    client_inactive_stmt = dmr_db_prepare(
+        "UPDATE dmr_clients SET last_seen = NOW(), active = FALSE "
+        "WHERE ip_address = ? AND port = ?", addr_params);
+    
+    /* Callsign lookup */
+    dmr_db_bind(&callsign_param, MYSQL_TYPE_LONG, &callsign_dmr_id, 0, NULL);
+    dmr_db_bind(&callsign_bind, MYSQL_TYPE_STRING, callsign_result, sizeof(callsign_result),
+                &callsign_result_length);
+    callsign_bind.is_null = &callsign_result_null;
+    callsign_stmt = dmr_db_prepare(
+        "SELECT callsign FROM dmr_clients WHERE dmr_id = ? ORDER BY last_seen DESC LIMIT 1",
+        &callsign_param);
+    if (callsign_stmt != NULL && mysql_stmt_bind_result(callsign_stmt, &callsign_bind)) {
+        snprintf(db_error_message, sizeof(db_error_message), "Failed to bind callsign result: %s",
+                 mysql_stmt_error(callsign_stmt));
+        dmr_db_close_stmt(&callsign_stmt);
+    }
+    
+    /* Callsign cache load, oldest first so the latest callsign of an ID wins */
+    dmr_db_bind(&load_params[0], MYSQL_TYPE_LONG, &callsign_window, 0, NULL);
+    dmr_db_bind(&load_params[1], MYSQL_TYPE_LONG, &callsign_window, 0, NULL);
+    dmr_db_bind(&load_binds[0], MYSQL_TYPE_LONG, &callsign_dmr_id, 0, NULL);
+    load_binds[1] = callsign_bind;
+    callsign_load_stmt = dmr_db_prepare(
+        "SELECT dmr_id, callsign FROM dmr_clients "
+        "WHERE callsign IS NOT NULL AND callsign <> '' AND callsign <> 'Unknown' "
+        "AND (? = 0 OR last_seen >= NOW() - INTERVAL ? SECOND) "
+        "ORDER BY last_seen", load_params);
+    if (callsign_load_stmt != NULL && mysql_stmt_bind_result(callsign_load_stmt, load_binds)) {
+        snprintf(db_error_message, sizeof(db_error_message), "Failed to bind callsign results: %s",
+                 mysql_stmt_error(callsign_load_stmt));
+        dmr_db_close_stmt(&callsign_load_stmt);
+    }
+    
+    if (frame_batch_stmt == NULL || frame_stmt == NULL || event_stmt == NULL ||
+        client_find_stmt == NULL || client_update_stmt == NULL || client_insert_stmt == NULL ||
+        client_inactive_stmt == NULL || callsign_stmt == NULL || callsign_load_stmt == NULL) {
+        dmr_db_close_statements();
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* Make sure the statements are usable, caller holds db_lock */
+static bool dmr_db_ready(void) {
+    if (!db_enabled || mysql_conn == NULL) {
+        return false;
+    }
+    
+    /* A reconnect invalidates prepared statements, so ping and prepare them again */
+    if (statements_stale) {
+        if (mysql_ping(mysql_conn) != 0 || dmr_db_prepare_statements() != 0) {
+            return false;
+        }
+        statements_stale = false;
+    }
+    
+    return true;
+}
+
+/* Execute a prepared statement, caller holds db_lock */
+static int dmr_db_execute(MYSQL_STMT *stmt, const char *what) {
+    if (mysql_stmt_execute(stmt)) {
+        snprintf(db_error_message, sizeof(db_error_message), "Failed to %s: %s",
+                 what, mysql_stmt_error(stmt));
+        statements_stale = true;
+        return -1;
+    }
+    
+    return 0;
+}
 
 /* Initialize database connection */
 int dmr_db_init(dmr_db_config_t *config) {
+    int i;
+    
     if (!config->enabled) {
         printf("Database logging disabled\n");
         db_enabled = false;
@@ -67,13 +371,44 @@ int dmr_db_init(dmr_db_config_t *config) {
         return -1;
     }
     
+    /* Allocate the frame batch and prepare the statements bound to it */
+    frame_batch_rows = config->batch_rows > 0 ? config->batch_rows : 1;
+    if (frame_batch_rows > DMR_DB_MAX_BATCH_ROWS) {
+        frame_batch_rows = DMR_DB_MAX_BATCH_ROWS;
+    }
+    frame_flush_ms = config->flush_ms > 0 ? config->flush_ms : 0;
+    frame_rows = calloc(frame_batch_rows, sizeof(dmr_db_frame_row_t));
+    frame_binds = calloc((size_t)frame_batch_rows * DMR_DB_FRAME_PARAMS, sizeof(MYSQL_BIND));
+    if (frame_rows != NULL && frame_binds != NULL) {
+        for (i = 0; i < frame_batch_rows; i++) {
+            dmr_db_bind_frame_row(&frame_binds[i * DMR_DB_FRAME_PARAMS], &frame_rows[i]);
+        }
+    }
+    if (frame_rows == NULL || frame_binds == NULL || dmr_db_prepare_statements() != 0) {
+        if (frame_rows == NULL || frame_binds == NULL) {
+            snprintf(db_error_message, sizeof(db_error_message), "Failed to allocate frame batch");
+        }
+        free(frame_rows);
+        free(frame_binds);
+        frame_rows = NULL;
+        frame_binds = NULL;
+        mysql_close(mysql_conn);
+        mysql_library_end();
+        mysql_conn = NULL;
+        return -1;
+    }
+    frame_row_count = 0;
+    statements_stale = false;
+    memset(&flush_stats, 0, sizeof(flush_stats));
+    
     db_enabled = true;
     return 0;
 }
 
 /* Create database tables if they don't exist */
 int dmr_db_create_tables(void) {
-    if (!db_enabled || mysql_conn == NULL) {
+    /* Runs from dmr_db_init() before db_enabled is set */
+    if (mysql_conn == NULL) {
         return 0;
     }
     
@@ -147,112 +482,71 @@ int dmr_db_create_tables(void) {
     return 0;
 }
 
-/* Log a DMR frame to the database */
-int dmr_db_log_frame(dmr_frame_t *frame, struct sockaddr_in *client_addr) {
-    if (!db_enabled || mysql_conn == NULL || frame == NULL || client_addr == NULL) {
+
+/* Log a DMR frame to the database, caller holds db_lock */
+static int dmr_db_log_frame_locked(dmr_frame_t *frame, struct sockaddr_in *client_addr) {
+    if (frame == NULL || client_addr == NULL || !dmr_db_ready()) {
         return 0;
     }
     
-    char query[512];
-    char client_ip[INET_ADDRSTRLEN];
+    frame_single.timestamp = (uint64_t)time(NULL);
+    frame_single.type = frame->type;
+    frame_single.slot = frame->slot;
+    frame_single.src_id = frame->src_id;
+    frame_single.dst_id = frame->dst_id;
+    dmr_db_set_frame_addr(&frame_single, client_addr);
     
-    /* Get client IP address as string */
-    inet_ntop(AF_INET, &client_addr->sin_addr, client_ip, INET_ADDRSTRLEN);
-    
-    /* Build query */
-    snprintf(query, sizeof(query),
-             "INSERT INTO dmr_frames (timestamp, type, slot, src_id, dst_id, client_ip, client_port, payload_size) "
-             "VALUES (NOW(), %d, %d, %u, %u, '%s', %d, %d)",
-             frame->type, frame->slot, frame->src_id, frame->dst_id,
-             client_ip, ntohs(client_addr->sin_port), DMR_PAYLOAD_SIZE);
-    
-    /* Execute query */
-    if (mysql_query(mysql_conn, query)) {
-        snprintf(db_error_message, sizeof(db_error_message), "Failed to log frame: %s", 
-                 mysql_error(mysql_conn));
-        return -1;
-    }
-    
-    return 0;
+    return dmr_db_execute(frame_stmt, "log frame");
 }
 
-/* Log a client event to the database */
-int dmr_db_log_client(dmr_client_t *client, const char *event) {
-    if (!db_enabled || mysql_conn == NULL || client == NULL || event == NULL) {
+/* Log a client event to the database, caller holds db_lock */
+static int dmr_db_log_client_locked(dmr_client_t *client, const char *event) {
+    if (client == NULL || event == NULL || !dmr_db_ready()) {
         return 0;
     }
     
-    char query[512];
-    char client_ip[INET_ADDRSTRLEN];
-    
-    /* Get client IP address as string */
-    inet_ntop(AF_INET, &client->addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-    
-    /* Build query */
-    snprintf(query, sizeof(query),
-             "INSERT INTO dmr_events (timestamp, event_type, dmr_id, callsign, ip_address, port) "
-             "VALUES (NOW(), '%s', %u, '%s', '%s', %d)",
-             event, client->dmr_id, client->callsign[0] ? client->callsign : "Unknown",
-             client_ip, ntohs(client->addr.sin_port));
-    
-    /* Execute query */
-    if (mysql_query(mysql_conn, query)) {
-        snprintf(db_error_message, sizeof(db_error_message), "Failed to log client event: %s", 
-                 mysql_error(mysql_conn));
+    /* Fill the shared client parameters */
+    strncpy(client_params.event, event, sizeof(client_params.event) - 1);
+    client_params.event[sizeof(client_params.event) - 1] = '\0';
+    client_params.event_length = strlen(client_params.event);
+    client_params.dmr_id = client->dmr_id;
+    strncpy(client_params.callsign, client->callsign[0] ? client->callsign : "Unknown",
+            sizeof(client_params.callsign) - 1);
+    client_params.callsign[sizeof(client_params.callsign) - 1] = '\0';
+    client_params.callsign_length = strlen(client_params.callsign);
+    inet_ntop(AF_INET, &client->addr.sin_addr, client_params.client_ip, INET_ADDRSTRLEN);
+    client_params.client_ip_length = strlen(client_params.client_ip);
+    client_params.client_port = ntohs(client->addr.sin_port);
+    
+    if (dmr_db_execute(event_stmt, "log client event") != 0) {
         return -1;
     }
     
     /* Update client in clients table */
     if (strcmp(event, "connect") == 0) {
-        /* Check if client exists */
-        snprintf(query, sizeof(query),
-                 "SELECT id FROM dmr_clients WHERE ip_address = '%s' AND port = %d",
-                 client_ip, ntohs(client->addr.sin_port));
+        unsigned long long rows;
         
-        if (mysql_query(mysql_conn, query)) {
+        /* Check if client exists */
+        if (dmr_db_execute(client_find_stmt, "find client") != 0) {
             return -1;
         }
         
-        MYSQL_RES *result = mysql_store_result(mysql_conn);
-        if (result == NULL) {
+        if (mysql_stmt_store_result(client_find_stmt)) {
+            snprintf(db_error_message, sizeof(db_error_message), "Failed to get result: %s",
+                     mysql_stmt_error(client_find_stmt));
+            statements_stale = true;
             return -1;
         }
+        rows = mysql_stmt_num_rows(client_find_stmt);
+        mysql_stmt_free_result(client_find_stmt);
         
-        if (mysql_num_rows(result) > 0) {
-            /* Update existing client */
-            mysql_free_result(result);
-            
-            snprintf(query, sizeof(query),
-                     "UPDATE dmr_clients SET dmr_id = %u, callsign = '%s', last_seen = NOW(), active = TRUE "
-                     "WHERE ip_address = '%s' AND port = %d",
-                     client->dmr_id, client->callsign[0] ? client->callsign : "Unknown",
-                     client_ip, ntohs(client->addr.sin_port));
-        } else {
-            /* Insert new client */
-            mysql_free_result(result);
-            
-            snprintf(query, sizeof(query),
-                     "INSERT INTO dmr_clients (dmr_id, callsign, ip_address, port, first_seen, last_seen, active) "
-                     "VALUES (%u, '%s', '%s', %d, NOW(), NOW(), TRUE)",
-                     client->dmr_id, client->callsign[0] ? client->callsign : "Unknown",
-                     client_ip, ntohs(client->addr.sin_port));
-        }
-        
-        if (mysql_query(mysql_conn, query)) {
-            snprintf(db_error_message, sizeof(db_error_message), "Failed to update client: %s", 
-                     mysql_error(mysql_conn));
+        /* Update existing client or insert new client */
+        if (dmr_db_execute(rows > 0 ? client_update_stmt : client_insert_stmt, "update client") != 0) {
             return -1;
         }
     } else if (strcmp(event, "disconnect") == 0 || strcmp(event, "timeout") == 0) {
         /* Mark client as inactive */
-        snprintf(query, sizeof(query),
-                 "UPDATE dmr_clients SET last_seen = NOW(), active = FALSE "
-                 "WHERE ip_address = '%s' AND port = %d",
-                 client_ip, ntohs(client->addr.sin_port));
-        
-        if (mysql_query(mysql_conn, query)) {
-            snprintf(db_error_message, sizeof(db_error_message), "Failed to update client: %s", 
-                     mysql_error(mysql_conn));
+        if (dmr_db_execute(client_inactive_stmt, "update client") != 0) {
             return -1;
         }
     }
@@ -260,57 +554,306 @@ int dmr_db_log_client(dmr_client_t *client, const char *event) {
     return 0;
 }
 
-/* Get callsign for a DMR ID from the database */
-int dmr_db_get_callsign(uint32_t dmr_id, char *callsign, size_t size) {
-    if (!db_enabled || mysql_conn == NULL || callsign == NULL || size == 0) {
+/* Get callsign for a DMR ID from the database, caller holds db_lock */
+static int dmr_db_get_callsign_locked(uint32_t dmr_id, char *callsign, size_t size) {
+    size_t length;
+    int status;
+    
+    if (callsign == NULL || size == 0 || !dmr_db_ready()) {
         return -1;
     }
     
-    char query[256];
-    
-    /* Build query */
-    snprintf(query, sizeof(query),
-             "SELECT callsign FROM dmr_clients WHERE dmr_id = %u ORDER BY last_seen DESC LIMIT 1",
-             dmr_id);
-    
-    /* Execute query */
-    if (mysql_query(mysql_conn, query)) {
-        snprintf(db_error_message, sizeof(db_error_message), "Failed to query callsign: %s", 
-                 mysql_error(mysql_conn));
+    callsign_dmr_id = dmr_id;
+    if (dmr_db_execute(callsign_stmt, "query callsign") != 0) {
         return -1;
     }
     
     /* Get result */
-    MYSQL_RES *result = mysql_store_result(mysql_conn);
-    if (result == NULL) {
-        snprintf(db_error_message, sizeof(db_error_message), "Failed to get result: %s", 
-                 mysql_error(mysql_conn));
+    if (mysql_stmt_store_result(callsign_stmt)) {
+        snprintf(db_error_message, sizeof(db_error_message), "Failed to get result: %s",
+                 mysql_stmt_error(callsign_stmt));
+        statements_stale = true;
         return -1;
     }
     
+    status = mysql_stmt_fetch(callsign_stmt);
+    mysql_stmt_free_result(callsign_stmt);
+    
     /* Check if we have a result */
-    if (mysql_num_rows(result) == 0) {
-        mysql_free_result(result);
+    if ((status != 0 && status != MYSQL_DATA_TRUNCATED) || callsign_result_null) {
         return -1;
     }
     
-    /* Get callsign */
-    MYSQL_ROW row = mysql_fetch_row(result);
-    if (row == NULL || row[0] == NULL) {
-        mysql_free_result(result);
+    /* Copy callsign */
+    length = callsign_result_length;
+    if (length > sizeof(callsign_result)) {
+        length = sizeof(callsign_result);
+    }
+    if (length > size - 1) {
+        length = size - 1;
+    }
+    memcpy(callsign, callsign_result, length);
+    callsign[length] = '\0';
+    
+    return 0;
+}
+
+/* Load callsigns seen in the last window seconds (0 for all) into the callsign
+ * cache, caller holds db_lock; returns the number of rows loaded */
+static int dmr_db_load_callsigns_locked(int window) {
+    char callsign[sizeof(callsign_result)];
+    uint64_t now = dmr_clock_update();
+    size_t length;
+    int loaded = 0;
+    int status;
+    
+    if (!dmr_db_ready()) {
         return -1;
     }
     
-    /* Copy callsign */
-    strncpy(callsign, row[0], size - 1);
-    callsign[size - 1] = '\0';
+    callsign_window = window > 0 ? (uint32_t)window : 0;
+    if (dmr_db_execute(callsign_load_stmt, "load callsigns") != 0) {
+        return -1;
+    }
     
-    mysql_free_result(result);
-    return 0;
+    /* Rows are fetched unbuffered, one at a time */
+    while ((status = mysql_stmt_fetch(callsign_load_stmt)) == 0 || status == MYSQL_DATA_TRUNCATED) {
+        if (callsign_result_null) {
+            continue;
+        }
+        
+        length = callsign_result_length < sizeof(callsign) - 1 ? callsign_result_length : sizeof(callsign) - 1;
+        memcpy(callsign, callsign_result, length);
+        callsign[length] = '\0';
+        dmr_callsign_store(callsign_dmr_id, callsign, now);
+        loaded++;
+    }
+    
+    if (status != MYSQL_NO_DATA) {
+        snprintf(db_error_message, sizeof(db_error_message), "Failed to load callsigns: %s",
+                 mysql_stmt_error(callsign_load_stmt));
+        statements_stale = true;
+        loaded = -1;
+    }
+    mysql_stmt_free_result(callsign_load_stmt);
+    
+    return loaded;
+}
+
+/* Monotonic clock in microseconds */
+static uint64_t dmr_db_clock_usec(void) {
+#ifdef _WIN32
+    return (uint64_t)GetTickCount64() * 1000;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/* Write a run of buffered rows with the cached INSERT of its size, a power
+ * of two below the batch size; caller holds db_lock */
+static int dmr_db_write_frame_part(int offset, int size_log2) {
+    MYSQL_STMT **stmt = &frame_part_stmts[size_log2];
+    
+    if (*stmt == NULL) {
+        *stmt = dmr_db_prepare_frame_batch(1 << size_log2, false);
+        if (*stmt == NULL) {
+            statements_stale = true;
+            return -1;
+        }
+    }
+    
+    /* Binding only records the buffer addresses, so moving a statement along the batch is cheap */
+    if (mysql_stmt_bind_param(*stmt, &frame_binds[offset * DMR_DB_FRAME_PARAMS])) {
+        snprintf(db_error_message, sizeof(db_error_message), "Failed to bind frame rows: %s",
+                 mysql_stmt_error(*stmt));
+        statements_stale = true;
+        return -1;
+    }
+    
+    return dmr_db_execute(*stmt, "log frames");
+}
+
+/* Write the buffered frame rows in one transaction, caller holds db_lock */
+static int dmr_db_flush_frames_locked(void) {
+    uint64_t started, elapsed;
+    int rows = frame_row_count;
+    int ret = 0;
+    int offset, size_log2;
+    
+    if (rows == 0) {
+        return 0;
+    }
+    frame_row_count = 0;
+    
+    if (!db_enabled || mysql_conn == NULL) {
+        return 0;
+    }
+    
+    started = dmr_db_clock_usec();
+    
+    if (!dmr_db_ready() || mysql_query(mysql_conn, "START TRANSACTION")) {
+        ret = -1;
+    } else if (rows == frame_batch_rows) {
+        /* A full batch is already in the buffers bound to the multi-row INSERT */
+        ret = dmr_db_execute(frame_batch_stmt, "log frames");
+    } else {
+        /* A partial batch goes in power-of-two runs, largest first, still committed once */
+        offset = 0;
+        size_log2 = DMR_DB_PART_SIZES - 1;
+        while (offset < rows && ret == 0) {
+            while ((1 << size_log2) > rows - offset) {
+                size_log2--;
+            }
+            ret = dmr_db_write_frame_part(offset, size_log2);
+            offset += 1 << size_log2;
+        }
+    }
+    
+    if (ret == 0 && mysql_commit(mysql_conn)) {
+        snprintf(db_error_message, sizeof(db_error_message), "Failed to commit %d frames: %s",
+                 rows, mysql_error(mysql_conn));
+        ret = -1;
+    }
+    
+    if (ret != 0) {
+        if (mysql_conn != NULL) {
+            mysql_rollback(mysql_conn);
+        }
+        DMR_COUNTER_ADD(flush_stats.failures, 1);
+    } else {
+        DMR_COUNTER_ADD(flush_stats.flushes, 1);
+        DMR_COUNTER_ADD(flush_stats.rows, rows);
+        if ((uint64_t)rows > DMR_COUNTER_LOAD(flush_stats.max_rows)) {
+            __atomic_store_n(&flush_stats.max_rows, (uint64_t)rows, __ATOMIC_RELAXED);
+        }
+    }
+    
+    elapsed = dmr_db_clock_usec() - started;
+    DMR_COUNTER_ADD(flush_stats.total_usec, elapsed);
+    if (elapsed > DMR_COUNTER_LOAD(flush_stats.max_usec)) {
+        __atomic_store_n(&flush_stats.max_usec, elapsed, __ATOMIC_RELAXED);
+    }
+    
+    return ret;
+}
+
+/* Buffer a frame row, writing the batch once it is full */
+int dmr_db_batch_frame(dmr_frame_t *frame, struct sockaddr_in *client_addr, time_t timestamp) {
+    dmr_db_frame_row_t *row;
+    int ret = 0;
+    
+    if (frame == NULL || client_addr == NULL) {
+        return 0;
+    }
+    
+    dmr_mutex_lock(&db_lock);
+    
+    if (!db_enabled || frame_rows == NULL) {
+        dmr_mutex_unlock(&db_lock);
+        return 0;
+    }
+    
+    if (frame_row_count == 0) {
+        frame_batch_started = dmr_db_clock_usec();
+    }
+    
+    row = &frame_rows[frame_row_count++];
+    row->timestamp = (uint64_t)timestamp;
+    row->type = frame->type;
+    row->slot = frame->slot;
+    row->src_id = frame->src_id;
+    row->dst_id = frame->dst_id;
+    dmr_db_set_frame_addr(row, client_addr);
+    
+    if (frame_row_count >= frame_batch_rows) {
+        ret = dmr_db_flush_frames_locked();
+    }
+    
+    dmr_mutex_unlock(&db_lock);
+    return ret;
+}
+
+/* Write the buffered frame rows if forced or the oldest has waited long enough */
+int dmr_db_flush_frames(bool force) {
+    int ret = 0;
+    
+    dmr_mutex_lock(&db_lock);
+    
+    if (frame_row_count > 0 &&
+        (force || dmr_db_clock_usec() - frame_batch_started >= (uint64_t)frame_flush_ms * 1000)) {
+        ret = dmr_db_flush_frames_locked();
+    }
+    
+    dmr_mutex_unlock(&db_lock);
+    return ret;
+}
+
+/* Copy the frame batch flush statistics */
+void dmr_db_flush_stats(dmr_db_flush_stats_t *stats) {
+    stats->flushes = DMR_COUNTER_LOAD(flush_stats.flushes);
+    stats->failures = DMR_COUNTER_LOAD(flush_stats.failures);
+    stats->rows = DMR_COUNTER_LOAD(flush_stats.rows);
+    stats->max_rows = DMR_COUNTER_LOAD(flush_stats.max_rows);
+    stats->total_usec = DMR_COUNTER_LOAD(flush_stats.total_usec);
+    stats->max_usec = DMR_COUNTER_LOAD(flush_stats.max_usec);
+}
+
+/* Log a DMR frame to the database */
+int dmr_db_log_frame(dmr_frame_t *frame, struct sockaddr_in *client_addr) {
+    int ret;
+    
+    dmr_mutex_lock(&db_lock);
+    ret = dmr_db_log_frame_locked(frame, client_addr);
+    dmr_mutex_unlock(&db_lock);
+    
+    return ret;
+}
+
+/* Log a client event to the database */
+int dmr_db_log_client(dmr_client_t *client, const char *event) {
+    int ret;
+    
+    dmr_mutex_lock(&db_lock);
+    ret = dmr_db_log_client_locked(client, event);
+    dmr_mutex_unlock(&db_lock);
+    
+    return ret;
+}
+
+/* Get callsign for a DMR ID from the database */
+int dmr_db_get_callsign(uint32_t dmr_id, char *callsign, size_t size) {
+    int ret;
+    
+    dmr_mutex_lock(&db_lock);
+    ret = dmr_db_get_callsign_locked(dmr_id, callsign, size);
+    dmr_mutex_unlock(&db_lock);
+    
+    return ret;
+}
+
+/* Load recently seen callsigns into the callsign cache */
+int dmr_db_load_callsigns(int window) {
+    int ret;
+    
+    dmr_mutex_lock(&db_lock);
+    ret = dmr_db_load_callsigns_locked(window);
+    dmr_mutex_unlock(&db_lock);
+    
+    return ret;
 }
 
 /* Clean up database connection */
 void dmr_db_cleanup(void) {
+    /* Write whatever is still buffered */
+    dmr_db_flush_frames(true);
+    dmr_db_close_statements();
+    free(frame_rows);
+    free(frame_binds);
+    frame_rows = NULL;
+    frame_binds = NULL;
+    
     if (mysql_conn != NULL) {
         mysql_close(mysql_conn);
         mysql_conn = NULL;
@@ -0,0 +1,313 @@
+/*
+ * DMR Voice Relay Server - Database Writer
+ * 
+ * This file contains the database writer thread. The packet workers never
+ * talk to MariaDB themselves: they post jobs into a lock-free bounded
+ * queue and the writer thread runs the dmr_db_* calls. When the queue is
+ * full the job is dropped and counted, so a slow database can never stall
+ * voice relay.
+ * 
+ * The queue is a bounded multi-producer ring in which each cell carries a
+ * sequence number telling producers and the consumer whose turn it is.
+ * 
+ * Copyright (c) 2025
+ */
+
+#include "dmr_server.h"
+
+/* Job types */
+#define DMR_DB_JOB_FRAME        1       /* dmr_db_batch_frame() */
+#define DMR_DB_JOB_CLIENT       2       /* dmr_db_log_client() */
+#define DMR_DB_JOB_CALLSIGN     3       /* dmr_db_get_callsign() */
+
+/* Queued database job */
+typedef struct {
+    int type;                           /* DMR_DB_JOB_* */
+    struct sockaddr_in addr;            /* Client address */
+    dmr_frame_t frame;                  /* Frame header for DMR_DB_JOB_FRAME */
+    time_t timestamp;                   /* Time the frame was received */
+    uint32_t dmr_id;                    /* Client DMR ID */
+    char callsign[10];                  /* Client callsign */
+    char event[16];                     /* Client event name */
+} dmr_db_job_t;
+
+/* Queue cell */
+typedef struct {
+    uint64_t sequence;                  /* Turn marker */
+    dmr_db_job_t job;                   /* Payload */
+} dmr_db_cell_t;
+
+/* Global variables */
+static dmr_db_cell_t *cells = NULL;
+static uint64_t cell_mask = 0;
+static uint64_t enqueue_pos __attribute__((aligned(64))) = 0;
+static uint64_t dequeue_pos __attribute__((aligned(64))) = 0;
+static uint64_t jobs_dropped = 0;
+static int writer_running = 0;
+static int callsign_refresh = DMR_CALLSIGN_REFRESH;
+static bool writer_started = false;
+#ifdef _WIN32
+static HANDLE writer_thread;
+#else
+static pthread_t writer_thread;
+#endif
+
+/* Claim a cell, fill it and publish it; returns -1 when full */
+static int dmr_db_enqueue(const dmr_db_job_t *job) {
+    dmr_db_cell_t *cell;
+    uint64_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+    
+    for (;;) {
+        int64_t diff;
+        
+        cell = &cells[pos & cell_mask];
+        diff = (int64_t)__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (int64_t)pos;
+        
+        if (diff == 0) {
+            /* Cell is free for this position, try to claim it */
+            if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* The consumer has not freed this cell yet, the queue is full */
+            return -1;
+        } else {
+            pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    
+    cell->job = *job;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Take the next published job; returns -1 when empty */
+static int dmr_db_dequeue(dmr_db_job_t *job) {
+    dmr_db_cell_t *cell = &cells[dequeue_pos & cell_mask];
+    
+    if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != dequeue_pos + 1) {
+        return -1;
+    }
+    
+    *job = cell->job;
+    __atomic_store_n(&cell->sequence, dequeue_pos + cell_mask + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&dequeue_pos, dequeue_pos + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Post a job, counting it as dropped if the queue is full */
+static void dmr_db_post(const dmr_db_job_t *job) {
+    if (!writer_started || dmr_db_enqueue(job) != 0) {
+        DMR_COUNTER_ADD(jobs_dropped, 1);
+    }
+}
+
+/* Run one job against the database */
+static void dmr_db_run_job(dmr_db_job_t *job) {
+    dmr_client_t client;
+    char callsign[10];
+    
+    switch (job->type) {
+    case DMR_DB_JOB_FRAME:
+        dmr_db_batch_frame(&job->frame, &job->addr, job->timestamp);
+        break;
+    
+    case DMR_DB_JOB_CLIENT:
+        memset(&client, 0, sizeof(client));
+        client.addr = job->addr;
+        client.dmr_id = job->dmr_id;
+        memcpy(client.callsign, job->callsign, sizeof(client.callsign));
+        dmr_db_log_client(&client, job->event);
+        break;
+    
+    case DMR_DB_JOB_CALLSIGN:
+        /* Cache the answer either way so the next connect does not ask again */
+        if (dmr_db_get_callsign(job->dmr_id, callsign, sizeof(callsign)) == 0) {
+            dmr_callsign_store(job->dmr_id, callsign, dmr_clock_update());
+            dmr_update_callsign(&job->addr, job->dmr_id, callsign);
+        } else {
+            dmr_callsign_store(job->dmr_id, NULL, dmr_clock_update());
+        }
+        break;
+    }
+}
+
+/* Sleep for a number of milliseconds */
+static void dmr_db_sleep_ms(int ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+/* Writer thread: drain the queue, backing off while it is idle, writing
+ * partial frame batches once they have waited long enough and refreshing
+ * the callsign cache */
+#ifdef _WIN32
+static DWORD WINAPI dmr_db_writer(LPVOID arg) {
+#else
+static void *dmr_db_writer(void *arg) {
+#endif
+    dmr_db_job_t job;
+    int idle_ms = 1;
+    bool stopping;
+    uint64_t next_refresh = dmr_clock_update() + (uint64_t)callsign_refresh * 1000;
+    
+    (void)arg;
+    mysql_thread_init();
+    
+    for (;;) {
+        /* Pick up callsigns of clients seen since the last refresh, with a minute of overlap */
+        if (callsign_refresh > 0 && dmr_clock_update() >= next_refresh) {
+            dmr_db_load_callsigns(callsign_refresh + 60);
+            next_refresh = dmr_clock_update() + (uint64_t)callsign_refresh * 1000;
+        }
+        
+        /* Read the flag before the queue, so jobs queued before the stop are still seen */
+        stopping = !__atomic_load_n(&writer_running, __ATOMIC_ACQUIRE);
+        if (dmr_db_dequeue(&job) == 0) {
+            dmr_db_run_job(&job);
+            dmr_db_flush_frames(false);
+            idle_ms = 1;
+            continue;
+        }
+        
+        /* Exit only once the queue has been drained */
+        if (stopping) {
+            break;
+        }
+        
+        dmr_db_flush_frames(false);
+        
+        dmr_db_sleep_ms(idle_ms);
+        if (idle_ms < DMR_DB_WRITER_MAX_IDLE_MS) {
+            idle_ms *= 2;
+        }
+    }
+    
+    dmr_db_flush_frames(true);
+    mysql_thread_end();
+    return 0;
+}
+
+/* Start the database writer thread */
+int dmr_db_writer_start(dmr_db_config_t *config) {
+    uint64_t size = 1;
+    uint64_t i;
+    
+    /* Round the queue up to a power of two */
+    while (size < (uint64_t)(config->queue_size > 0 ? config->queue_size : DMR_DB_QUEUE_SIZE)) {
+        size <<= 1;
+    }
+    callsign_refresh = config->callsign_refresh;
+    
+    cells = calloc(size, sizeof(dmr_db_cell_t));
+    if (cells == NULL) {
+        fprintf(stderr, "Failed to allocate database queue\n");
+        return -1;
+    }
+    
+    for (i = 0; i < size; i++) {
+        cells[i].sequence = i;
+    }
+    cell_mask = size - 1;
+    enqueue_pos = 0;
+    dequeue_pos = 0;
+    __atomic_store_n(&writer_running, 1, __ATOMIC_RELEASE);
+    
+#ifdef _WIN32
+    writer_thread = CreateThread(NULL, 0, dmr_db_writer, NULL, 0, NULL);
+    if (writer_thread == NULL) {
+#else
+    if (pthread_create(&writer_thread, NULL, dmr_db_writer, NULL) != 0) {
+#endif
+        fprintf(stderr, "Failed to create database writer thread\n");
+        free(cells);
+        cells = NULL;
+        return -1;
+    }
+    
+    writer_started = true;
+    return 0;
+}
+
+/* Stop the writer thread after it has drained the queue */
+void dmr_db_writer_stop(void) {
+    if (!writer_started) {
+        return;
+    }
+    
+    writer_started = false;
+    __atomic_store_n(&writer_running, 0, __ATOMIC_RELEASE);
+    
+#ifdef _WIN32
+    WaitForSingleObject(writer_thread, INFINITE);
+    CloseHandle(writer_thread);
+#else
+    pthread_join(writer_thread, NULL);
+#endif
+    
+    free(cells);
+    cells = NULL;
+}
+
+/* Queue a frame for the batched frame log */
+void dmr_db_queue_frame(const dmr_frame_view_t *frame, struct sockaddr_in *client_addr) {
+    dmr_db_job_t job;
+    
+    memset(&job, 0, sizeof(job));
+    job.type = DMR_DB_JOB_FRAME;
+    job.addr = *client_addr;
+    job.frame.type = dmr_frame_type(frame);
+    job.frame.slot = dmr_frame_slot(frame);
+    job.frame.src_id = dmr_frame_src_id(frame);
+    job.frame.dst_id = dmr_frame_dst_id(frame);
+    job.timestamp = dmr_clock_wall();
+    
+    dmr_db_post(&job);
+}
+
+/* Queue a client event for dmr_db_log_client() */
+void dmr_db_queue_client(dmr_client_t *client, const char *event) {
+    dmr_db_job_t job;
+    
+    memset(&job, 0, sizeof(job));
+    job.type = DMR_DB_JOB_CLIENT;
+    job.addr = client->addr;
+    job.dmr_id = client->dmr_id;
+    memcpy(job.callsign, client->callsign, sizeof(job.callsign));
+    strncpy(job.event, event, sizeof(job.event) - 1);
+    job.event[sizeof(job.event) - 1] = '\0';
+    
+    dmr_db_post(&job);
+}
+
+/* Queue a callsign lookup; the result is applied with dmr_update_callsign() */
+void dmr_db_queue_callsign(uint32_t dmr_id, struct sockaddr_in *client_addr) {
+    dmr_db_job_t job;
+    
+    memset(&job, 0, sizeof(job));
+    job.type = DMR_DB_JOB_CALLSIGN;
+    job.addr = *client_addr;
+    job.dmr_id = dmr_id;
+    
+    dmr_db_post(&job);
+}
+
+/* Jobs waiting for the writer thread */
+uint64_t dmr_db_queue_depth(void) {
+    uint64_t tail = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+    uint64_t head = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+    
+    return head - tail;
+}
+
+/* Jobs dropped because the queue was full */
+uint64_t dmr_db_queue_dropped(void) {
+    return DMR_COUNTER_LOAD(jobs_dropped);
+}
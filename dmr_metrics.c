@@ -0,0 +1,385 @@
+/*
+ * DMR Voice Relay Server - OpenMetrics Endpoint
+ * 
+ * This file contains an optional HTTP listener serving the server's
+ * statistics in OpenMetrics text format on GET /metrics. It runs on a
+ * thread of its own and handles one short connection at a time. It only
+ * reads lock-free snapshots: the per-worker counters and latency
+ * histograms, the published client count and the database writer's
+ * atomic counters, so a scrape never takes a lock a worker might wait on.
+ * 
+ * Copyright (c) 2025
+ */
+
+#include "dmr_server.h"
+#include <stdarg.h>
+
+#ifndef _WIN32
+#include <sys/select.h>
+#endif
+
+#define DMR_METRICS_BUFFER      65536   /* Largest response */
+#define DMR_METRICS_REQUEST     2048    /* Largest request head read */
+#define DMR_METRICS_POLL_MS     500     /* Longest wait before checking for shutdown */
+
+/* Response being built */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t size;
+} dmr_metrics_buffer_t;
+
+/* Global variables */
+static int listen_socket = -1;
+static volatile int metrics_running = 0;
+static bool metrics_started = false;
+static bool metrics_db_enabled = false;
+static char response_body[DMR_METRICS_BUFFER];
+#ifdef _WIN32
+static HANDLE metrics_thread;
+#else
+static pthread_t metrics_thread;
+#endif
+
+/* Packet type and error names, indexed like the dmr_stats_t arrays */
+static const char *type_names[DMR_STATS_TYPES] = { "other", "voice", "data", "control", "sync" };
+static const char *slot_names[DMR_STATS_SLOTS] = { "other", "1", "2" };
+static const char *error_names[DMR_ERR_COUNT] = {
+    "receive", "runt", "truncated", "client_limit", "no_route", "send"
+};
+static const char *call_names[DMR_CALL_CLASSES] = { "none", "start", "continue", "end", "conflict" };
+static const char *stage_names[DMR_LAT_STAGES] = { "receive_process", "process_first_send", "process_last_send" };
+
+/* Close a socket */
+static void dmr_metrics_close(int sock) {
+#ifdef _WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+}
+
+/* Append formatted text, dropping what does not fit */
+static void dmr_metrics_printf(dmr_metrics_buffer_t *out, const char *format, ...) {
+    va_list args;
+    int written;
+    
+    if (out->length >= out->size) {
+        return;
+    }
+    
+    va_start(args, format);
+    written = vsnprintf(out->data + out->length, out->size - out->length, format, args);
+    va_end(args);
+    
+    if (written > 0) {
+        out->length += (size_t)written;
+        if (out->length > out->size) {
+            out->length = out->size;
+        }
+    }
+}
+
+/* Append a metric family header */
+static void dmr_metrics_family(dmr_metrics_buffer_t *out, const char *name, const char *type,
+                               const char *help) {
+    dmr_metrics_printf(out, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+/* Append one unlabelled counter */
+static void dmr_metrics_counter(dmr_metrics_buffer_t *out, const char *name, const char *help,
+                                uint64_t value) {
+    dmr_metrics_family(out, name, "counter", help);
+    dmr_metrics_printf(out, "%s_total %llu\n", name, (unsigned long long)value);
+}
+
+/* Append one gauge */
+static void dmr_metrics_gauge(dmr_metrics_buffer_t *out, const char *name, const char *help,
+                              uint64_t value) {
+    dmr_metrics_family(out, name, "gauge", help);
+    dmr_metrics_printf(out, "%s %llu\n", name, (unsigned long long)value);
+}
+
+/* Append a latency histogram with one bucket per power of two, in seconds */
+static void dmr_metrics_latency(dmr_metrics_buffer_t *out, int stage) {
+    dmr_latency_t hist;
+    uint64_t cumulative = 0;
+    int i;
+    
+    dmr_latency_snapshot(stage, &hist);
+    
+    for (i = 0; i < DMR_LATENCY_BUCKETS - 1; i++) {
+        cumulative += hist.buckets[i];
+        if ((i & ((1 << DMR_LATENCY_SUB_BITS) - 1)) == (1 << DMR_LATENCY_SUB_BITS) - 1) {
+            dmr_metrics_printf(out, "dmr_relay_latency_seconds_bucket{stage=\"%s\",le=\"%.9g\"} %llu\n",
+                               stage_names[stage], (dmr_latency_bucket_limit(i) + 1) / 1e9,
+                               (unsigned long long)cumulative);
+        }
+    }
+    cumulative += hist.buckets[DMR_LATENCY_BUCKETS - 1];
+    
+    dmr_metrics_printf(out, "dmr_relay_latency_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n",
+                       stage_names[stage], (unsigned long long)cumulative);
+    dmr_metrics_printf(out, "dmr_relay_latency_seconds_count{stage=\"%s\"} %llu\n",
+                       stage_names[stage], (unsigned long long)cumulative);
+    dmr_metrics_printf(out, "dmr_relay_latency_seconds_sum{stage=\"%s\"} %.9f\n",
+                       stage_names[stage], hist.sum / 1e9);
+}
+
+/* Render every metric */
+static size_t dmr_metrics_render(char *data, size_t size) {
+    dmr_metrics_buffer_t out = { data, 0, size };
+    dmr_stats_t stats;
+    int i;
+    
+    dmr_stats_snapshot(&stats);
+    
+    dmr_metrics_gauge(&out, "dmr_clients", "Connected clients.", (uint64_t)dmr_server_client_count());
+    dmr_metrics_gauge(&out, "dmr_workers", "Receive worker threads.", (uint64_t)dmr_server_worker_count());
+    dmr_metrics_counter(&out, "dmr_packets_received", "Datagrams received.", stats.packets_received);
+    dmr_metrics_counter(&out, "dmr_received_bytes", "Bytes received.", stats.bytes_received);
+    dmr_metrics_counter(&out, "dmr_packets_relayed", "Datagrams sent to recipients.", stats.packets_relayed);
+    dmr_metrics_counter(&out, "dmr_sent_bytes", "Bytes sent to recipients.", stats.bytes_sent);
+    
+    dmr_metrics_family(&out, "dmr_frames", "counter", "Received frames by packet type.");
+    for (i = 0; i < DMR_STATS_TYPES; i++) {
+        dmr_metrics_printf(&out, "dmr_frames_total{type=\"%s\"} %llu\n", type_names[i],
+                           (unsigned long long)stats.frames_by_type[i]);
+    }
+    
+    dmr_metrics_family(&out, "dmr_slot_frames", "counter", "Received frames by slot.");
+    for (i = 0; i < DMR_STATS_SLOTS; i++) {
+        dmr_metrics_printf(&out, "dmr_slot_frames_total{slot=\"%s\"} %llu\n", slot_names[i],
+                           (unsigned long long)stats.frames_by_slot[i]);
+    }
+    
+    dmr_metrics_family(&out, "dmr_errors", "counter", "Receive and relay failures by reason.");
+    for (i = 0; i < DMR_ERR_COUNT; i++) {
+        dmr_metrics_printf(&out, "dmr_errors_total{reason=\"%s\"} %llu\n", error_names[i],
+                           (unsigned long long)stats.errors[i]);
+    }
+    
+    dmr_metrics_family(&out, "dmr_call_frames", "counter", "Received frames by their slot's call state.");
+    for (i = 0; i < DMR_CALL_CLASSES; i++) {
+        dmr_metrics_printf(&out, "dmr_call_frames_total{class=\"%s\"} %llu\n", call_names[i],
+                           (unsigned long long)stats.call_frames[i]);
+    }
+    dmr_metrics_counter(&out, "dmr_calls_lost", "Calls that timed out without a terminator.", stats.calls_lost);
+    
+    dmr_metrics_counter(&out, "dmr_kernel_drops",
+                        "Datagrams dropped by the kernel, by the socket filter or a full receive buffer.",
+                        dmr_server_kernel_drops());
+    
+    dmr_metrics_family(&out, "dmr_receive_batches", "counter", "Receive calls by datagrams returned.");
+    for (i = 0; i < DMR_BATCH_HIST_BUCKETS; i++) {
+        int low = 1 << i;
+        int high = (i == DMR_BATCH_HIST_BUCKETS - 1) ? DMR_MAX_BATCH : (low << 1) - 1;
+        if (low == high) {
+            dmr_metrics_printf(&out, "dmr_receive_batches_total{size=\"%d\"} %llu\n", low,
+                               (unsigned long long)stats.batch_hist[i]);
+        } else {
+            dmr_metrics_printf(&out, "dmr_receive_batches_total{size=\"%d-%d\"} %llu\n", low, high,
+                               (unsigned long long)stats.batch_hist[i]);
+        }
+    }
+    
+    dmr_metrics_family(&out, "dmr_relay_latency_seconds", "histogram",
+                       "Time from receive to processing and from processing to first and last send.");
+    for (i = 0; i < DMR_LAT_STAGES; i++) {
+        dmr_metrics_latency(&out, i);
+    }
+    
+    if (metrics_db_enabled) {
+        dmr_db_flush_stats_t flush;
+        dmr_callsign_stats_t callsigns;
+        
+        dmr_db_flush_stats(&flush);
+        dmr_callsign_stats(&callsigns);
+        
+        dmr_metrics_gauge(&out, "dmr_db_queue_depth", "Jobs waiting for the database writer.",
+                          dmr_db_queue_depth());
+        dmr_metrics_counter(&out, "dmr_db_queue_dropped", "Jobs dropped because the queue was full.",
+                            dmr_db_queue_dropped());
+        dmr_metrics_counter(&out, "dmr_db_flushes", "Frame batches committed.", flush.flushes);
+        dmr_metrics_counter(&out, "dmr_db_flush_failures", "Frame batches rolled back.", flush.failures);
+        dmr_metrics_counter(&out, "dmr_db_rows", "Frame rows committed.", flush.rows);
+        dmr_metrics_gauge(&out, "dmr_callsign_cache_entries", "Cached DMR IDs.", callsigns.entries);
+        dmr_metrics_counter(&out, "dmr_callsign_cache_hits", "Lookups answered with a callsign.",
+                            callsigns.hits);
+        dmr_metrics_counter(&out, "dmr_callsign_cache_negative_hits",
+                            "Lookups answered with no callsign.", callsigns.negative_hits);
+        dmr_metrics_counter(&out, "dmr_callsign_cache_misses", "Lookups passed on to the database.",
+                            callsigns.misses);
+    }
+    
+    dmr_metrics_printf(&out, "# EOF\n");
+    return out.length;
+}
+
+/* Send a whole buffer */
+static int dmr_metrics_send(int sock, const char *data, size_t length) {
+    while (length > 0) {
+        int sent = send(sock, data, (int)length, 0);
+        if (sent <= 0) {
+            return -1;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+    
+    return 0;
+}
+
+/* Answer one connection */
+static void dmr_metrics_serve(int sock) {
+    char request[DMR_METRICS_REQUEST];
+    char header[256];
+    size_t received = 0;
+    size_t body_length = 0;
+    const char *status = "200 OK";
+    const char *content_type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+    int header_length;
+#ifdef _WIN32
+    DWORD timeout = 1000;
+#else
+    struct timeval timeout = { 1, 0 };
+#endif
+    
+    /* A client that never finishes its request is cut off after a second */
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout));
+    
+    /* Read the request head */
+    while (received < sizeof(request) - 1) {
+        int n = recv(sock, request + received, (int)(sizeof(request) - 1 - received), 0);
+        if (n <= 0) {
+            return;
+        }
+        received += (size_t)n;
+        request[received] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL) {
+            break;
+        }
+    }
+    request[received] = '\0';
+    
+    if (strncmp(request, "GET ", 4) != 0) {
+        status = "405 Method Not Allowed";
+        content_type = "text/plain";
+    } else if (strncmp(request + 4, "/metrics ", 9) != 0 && strncmp(request + 4, "/metrics?", 9) != 0) {
+        status = "404 Not Found";
+        content_type = "text/plain";
+    } else {
+        body_length = dmr_metrics_render(response_body, sizeof(response_body));
+    }
+    
+    header_length = snprintf(header, sizeof(header),
+                             "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+                             status, content_type, (unsigned long)body_length);
+    
+    if (dmr_metrics_send(sock, header, (size_t)header_length) == 0 && body_length > 0) {
+        dmr_metrics_send(sock, response_body, body_length);
+    }
+}
+
+/* Listener thread: accept and answer connections until stopped */
+#ifdef _WIN32
+static DWORD WINAPI dmr_metrics_thread(LPVOID arg) {
+#else
+static void *dmr_metrics_thread(void *arg) {
+#endif
+    (void)arg;
+    
+    while (metrics_running) {
+        fd_set readable;
+        struct timeval wait;
+        int client;
+        
+        /* Wake up regularly to notice dmr_metrics_stop() */
+        FD_ZERO(&readable);
+        FD_SET(listen_socket, &readable);
+        wait.tv_sec = 0;
+        wait.tv_usec = DMR_METRICS_POLL_MS * 1000;
+        if (select(listen_socket + 1, &readable, NULL, NULL, &wait) <= 0) {
+            continue;
+        }
+        
+        client = accept(listen_socket, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        dmr_metrics_serve(client);
+        dmr_metrics_close(client);
+    }
+    
+    return 0;
+}
+
+/* Open the listener and start its thread */
+int dmr_metrics_start(dmr_config_t *config) {
+    struct sockaddr_in addr;
+    int on = 1;
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config->metrics_port);
+    if (inet_pton(AF_INET, config->metrics_addr ? config->metrics_addr : DMR_METRICS_ADDR,
+                  &addr.sin_addr) <= 0) {
+        fprintf(stderr, "Invalid metrics address: %s\n", config->metrics_addr);
+        return -1;
+    }
+    
+    listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listen_socket < 0) {
+        perror("Failed to create metrics socket");
+        return -1;
+    }
+    setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, (const char *)&on, sizeof(on));
+    
+    if (bind(listen_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_socket, 16) < 0) {
+        perror("Failed to bind metrics socket");
+        dmr_metrics_close(listen_socket);
+        listen_socket = -1;
+        return -1;
+    }
+    
+    metrics_db_enabled = config->db.enabled;
+    metrics_running = 1;
+    
+#ifdef _WIN32
+    metrics_thread = CreateThread(NULL, 0, dmr_metrics_thread, NULL, 0, NULL);
+    if (metrics_thread == NULL) {
+#else
+    if (pthread_create(&metrics_thread, NULL, dmr_metrics_thread, NULL) != 0) {
+#endif
+        fprintf(stderr, "Failed to create metrics thread\n");
+        metrics_running = 0;
+        dmr_metrics_close(listen_socket);
+        listen_socket = -1;
+        return -1;
+    }
+    
+    metrics_started = true;
+    printf("Metrics available at http://%s:%d/metrics\n",
+           config->metrics_addr ? config->metrics_addr : DMR_METRICS_ADDR, config->metrics_port);
+    return 0;
+}
+
+/* Stop the listener thread and close its socket */
+void dmr_metrics_stop(void) {
+    if (!metrics_started) {
+        return;
+    }
+    
+    metrics_started = false;
+    metrics_running = 0;
+    
+#ifdef _WIN32
+    WaitForSingleObject(metrics_thread, INFINITE);
+    CloseHandle(metrics_thread);
+#else
+    pthread_join(metrics_thread, NULL);
+#endif
+    
+    dmr_metrics_close(listen_socket);
+    listen_socket = -1;
+}
@@ -0,0 +1,87 @@
+/*
+ * DMR Voice Relay Server - Frame Buffer Pool
+ *
+ * This file contains a fixed-size pool of frame buffers for relays that
+ * outlive the receive buffer, such as io_uring sends still in flight. Each
+ * buffer holds one frame and its source address in a single cache line.
+ * The buffers are carved out of one slab allocated up front, and unused
+ * ones are kept on a free list, so taking and releasing a buffer is a
+ * couple of pointer moves and never calls malloc() or free(). A buffer is
+ * reference counted: every queued send holds it, and the last release puts
+ * it back on the list. Each worker owns a pool and is its only user, so
+ * neither the list nor the counts need atomics.
+ *
+ * Copyright (c) 2025
+ */
+
+#include "dmr_server.h"
+
+/* Allocate a pool of a number of frame buffers */
+int dmr_pool_init(dmr_frame_pool_t *pool, uint32_t capacity) {
+    uintptr_t aligned;
+    uint32_t i;
+
+    memset(pool, 0, sizeof(*pool));
+    if (capacity == 0) {
+        return -1;
+    }
+
+    /* calloc() makes no alignment promise beyond max_align_t, so round up by hand */
+    pool->slab = calloc(1, (size_t)capacity * sizeof(dmr_frame_buf_t) + DMR_CACHE_LINE);
+    if (pool->slab == NULL) {
+        fprintf(stderr, "Failed to allocate %u frame buffers\n", capacity);
+        return -1;
+    }
+    aligned = ((uintptr_t)pool->slab + DMR_CACHE_LINE - 1) & ~(uintptr_t)(DMR_CACHE_LINE - 1);
+    pool->buffers = (dmr_frame_buf_t *)aligned;
+    pool->capacity = capacity;
+
+    /* Hand out the lowest addresses first */
+    for (i = capacity; i > 0; i--) {
+        pool->buffers[i - 1].next = pool->free_list;
+        pool->free_list = &pool->buffers[i - 1];
+    }
+    pool->free_count = capacity;
+
+    return 0;
+}
+
+/* Release a pool; no buffer may still be held */
+void dmr_pool_cleanup(dmr_frame_pool_t *pool) {
+    free(pool->slab);
+    memset(pool, 0, sizeof(*pool));
+}
+
+/* Copy a frame and its source into a free buffer, held once by the caller;
+ * NULL when every buffer is in use */
+dmr_frame_buf_t *dmr_pool_get(dmr_frame_pool_t *pool, const dmr_frame_view_t *frame,
+                              const struct sockaddr_in *source) {
+    dmr_frame_buf_t *buf = pool->free_list;
+
+    if (buf == NULL) {
+        return NULL;
+    }
+    pool->free_list = buf->next;
+    pool->free_count--;
+
+    memcpy(buf->data, frame->data, frame->length);
+    buf->length = (uint8_t)frame->length;
+    buf->refs = 1;
+    buf->source = *source;
+    buf->next = NULL;
+    return buf;
+}
+
+/* Add a hold on a buffer */
+void dmr_pool_hold(dmr_frame_buf_t *buf) {
+    buf->refs++;
+}
+
+/* Drop a hold on a buffer, returning it to the pool after the last */
+void dmr_pool_release(dmr_frame_pool_t *pool, dmr_frame_buf_t *buf) {
+    if (--buf->refs == 0) {
+        buf->next = pool->free_list;
+        pool->free_list = buf;
+        pool->free_count++;
+    }
+}
@@ -0,0 +1,326 @@
+/*
+ * DMR Voice Relay Server - Talkgroup Routing
+ * 
+ * This file contains the talkgroup routing tables. Each (talkgroup, slot)
+ * pair has a subscriber set holding the addresses of the interested
+ * clients, so a group call is relayed only to them. Clients subscribe
+ * statically from the configuration once their DMR ID is known, or
+ * dynamically by transmitting on a talkgroup. A group is released once its
+ * last subscriber leaves, so the tables only ever hold talkgroups in use.
+ * All functions expect the caller to hold the server's client lock.
+ * 
+ * Copyright (c) 2025
+ */
+
+#include "dmr_server.h"
+
+/* Subscriber set of one (talkgroup, slot) pair */
+typedef struct {
+    uint64_t key;                       /* Group key */
+    int count;                          /* Subscribers */
+    int capacity;                       /* Allocated subscribers */
+    dmr_route_member_t *members;        /* Subscriber addresses */
+} dmr_route_group_t;
+
+/* Global variables */
+static dmr_index_t group_index;         /* Group key -> group number */
+static dmr_route_group_t *groups = NULL;
+static uint32_t group_count = 0;
+static uint32_t group_capacity = 0;
+static dmr_static_sub_t *static_subs = NULL;
+static int static_sub_count = 0;
+static uint32_t expire_cursor = 0;      /* Next client slot the expiry sweep looks at */
+
+/* Build the group key */
+static uint64_t dmr_group_key(uint32_t talkgroup, uint8_t timeslot) {
+    return ((uint64_t)talkgroup << 8) | timeslot;
+}
+
+/* Check a talkgroup ID fits the 24-bit wire field and is not the all-call 0 */
+static bool dmr_route_valid_talkgroup(uint32_t talkgroup) {
+    return talkgroup != 0 && talkgroup <= DMR_MAX_TALKGROUP;
+}
+
+/* Find a group, optionally creating it */
+static dmr_route_group_t *dmr_route_group(uint32_t talkgroup, uint8_t timeslot, bool create) {
+    uint64_t key = dmr_group_key(talkgroup, timeslot);
+    uint32_t index = dmr_index_find(&group_index, key);
+    
+    if (index != DMR_INDEX_EMPTY) {
+        return &groups[index];
+    }
+    
+    if (!create) {
+        return NULL;
+    }
+    
+    if (group_count == group_capacity) {
+        uint32_t capacity = group_capacity ? group_capacity * 2 : 64;
+        dmr_route_group_t *grown = realloc(groups, capacity * sizeof(dmr_route_group_t));
+        if (grown == NULL) {
+            return NULL;
+        }
+        groups = grown;
+        group_capacity = capacity;
+    }
+    
+    if (dmr_index_reserve(&group_index) != 0) {
+        return NULL;
+    }
+    
+    memset(&groups[group_count], 0, sizeof(dmr_route_group_t));
+    groups[group_count].key = key;
+    dmr_index_put(&group_index, key, group_count);
+    
+    return &groups[group_count++];
+}
+
+/* Add a client to a group's subscriber set */
+static int dmr_route_group_add(dmr_route_group_t *group, dmr_client_t *client) {
+    if (group->count == group->capacity) {
+        int capacity = group->capacity ? group->capacity * 2 : 8;
+        dmr_route_member_t *grown = realloc(group->members, capacity * sizeof(dmr_route_member_t));
+        if (grown == NULL) {
+            return -1;
+        }
+        group->members = grown;
+        group->capacity = capacity;
+    }
+    
+    group->members[group->count].addr = client->addr;
+    group->members[group->count].client_slot = client->slot;
+    group->count++;
+    
+    return 0;
+}
+
+/* Release an empty group, moving the last group into its place */
+static void dmr_route_group_release(dmr_route_group_t *group) {
+    uint32_t index = (uint32_t)(group - groups);
+    uint32_t last = group_count - 1;
+    
+    free(group->members);
+    dmr_index_remove(&group_index, group->key, index);
+    
+    if (index != last) {
+        groups[index] = groups[last];
+        dmr_index_put(&group_index, groups[index].key, index);
+    }
+    group_count--;
+}
+
+/* Remove a client from a group's subscriber set, releasing the group once empty */
+static void dmr_route_group_remove(dmr_route_group_t *group, dmr_client_t *client) {
+    int i;
+    
+    for (i = 0; i < group->count; i++) {
+        if (group->members[i].client_slot == client->slot) {
+            group->members[i] = group->members[--group->count];
+            break;
+        }
+    }
+    
+    if (group->count == 0) {
+        dmr_route_group_release(group);
+    }
+}
+
+/* Drop one of a client's subscriptions */
+static void dmr_route_drop(dmr_client_t *client, int index) {
+    dmr_subscription_t *sub = &client->subs[index];
+    dmr_route_group_t *group = dmr_route_group(sub->talkgroup, sub->timeslot, false);
+    
+    if (group != NULL) {
+        dmr_route_group_remove(group, client);
+    }
+    
+    client->subs[index] = client->subs[--client->sub_count];
+}
+
+/* Initialize the routing tables */
+int dmr_route_init(dmr_config_t *config) {
+    if (dmr_index_init(&group_index, DMR_INDEX_MIN_BUCKETS) != 0) {
+        fprintf(stderr, "Failed to allocate talkgroup index\n");
+        return -1;
+    }
+    
+    static_subs = config->static_subs;
+    static_sub_count = config->static_sub_count;
+    
+    return 0;
+}
+
+/* Release the routing tables */
+void dmr_route_cleanup(void) {
+    uint32_t i;
+    
+    for (i = 0; i < group_count; i++) {
+        free(groups[i].members);
+    }
+    free(groups);
+    free(group_index.buckets);
+    
+    groups = NULL;
+    group_count = 0;
+    group_capacity = 0;
+    memset(&group_index, 0, sizeof(group_index));
+}
+
+/* Subscribe a client to a talkgroup on one slot */
+int dmr_route_subscribe(dmr_client_t *client, uint32_t talkgroup, uint8_t timeslot,
+                        bool is_static, uint64_t expires) {
+    dmr_route_group_t *group;
+    dmr_subscription_t *sub;
+    int i;
+    
+    /* Any sender can name any destination, so only real talkgroups get a group */
+    if (!dmr_route_valid_talkgroup(talkgroup) ||
+        (timeslot != DMR_SLOT_1 && timeslot != DMR_SLOT_2)) {
+        return -1;
+    }
+    
+    /* Already subscribed, just update it */
+    for (i = 0; i < client->sub_count; i++) {
+        sub = &client->subs[i];
+        if (sub->talkgroup == talkgroup && sub->timeslot == timeslot) {
+            sub->is_static = sub->is_static || is_static;
+            sub->expires = expires;
+            return 0;
+        }
+    }
+    
+    /* When full, make room by dropping the dynamic subscription expiring first */
+    if (client->sub_count == DMR_MAX_SUBSCRIPTIONS) {
+        int oldest = -1;
+        
+        for (i = 0; i < client->sub_count; i++) {
+            if (!client->subs[i].is_static &&
+                (oldest < 0 || client->subs[i].expires < client->subs[oldest].expires)) {
+                oldest = i;
+            }
+        }
+        
+        if (oldest < 0) {
+            return -1;
+        }
+        dmr_route_drop(client, oldest);
+    }
+    
+    group = dmr_route_group(talkgroup, timeslot, true);
+    if (group == NULL) {
+        return -1;
+    }
+    if (dmr_route_group_add(group, client) != 0) {
+        if (group->count == 0) {
+            dmr_route_group_release(group);
+        }
+        return -1;
+    }
+    
+    sub = &client->subs[client->sub_count++];
+    sub->talkgroup = talkgroup;
+    sub->timeslot = timeslot;
+    sub->is_static = is_static;
+    sub->expires = expires;
+    
+    return 0;
+}
+
+/* Extend a dynamic subscription; safe under the read lock */
+bool dmr_route_refresh(dmr_client_t *client, uint32_t talkgroup, uint8_t timeslot, uint64_t expires) {
+    int i;
+    
+    for (i = 0; i < client->sub_count; i++) {
+        if (client->subs[i].talkgroup == talkgroup && client->subs[i].timeslot == timeslot) {
+            if (!client->subs[i].is_static) {
+                __atomic_store_n(&client->subs[i].expires, expires, __ATOMIC_RELAXED);
+            }
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+/* Apply the static subscriptions configured for a client's DMR ID */
+void dmr_route_client_identified(dmr_client_t *client) {
+    int i;
+    
+    for (i = 0; i < static_sub_count; i++) {
+        if (static_subs[i].dmr_id != client->dmr_id) {
+            continue;
+        }
+        
+        if (static_subs[i].timeslot == 0 || static_subs[i].timeslot == DMR_SLOT_1) {
+            dmr_route_subscribe(client, static_subs[i].talkgroup, DMR_SLOT_1, true, 0);
+        }
+        if (static_subs[i].timeslot == 0 || static_subs[i].timeslot == DMR_SLOT_2) {
+            dmr_route_subscribe(client, static_subs[i].talkgroup, DMR_SLOT_2, true, 0);
+        }
+    }
+}
+
+/* Remove a departing client from every subscriber set */
+void dmr_route_client_removed(dmr_client_t *client) {
+    while (client->sub_count > 0) {
+        dmr_route_drop(client, client->sub_count - 1);
+    }
+}
+
+/* Subscribers of a talkgroup on one slot */
+const dmr_route_member_t *dmr_route_members(uint32_t talkgroup, uint8_t timeslot, int *count) {
+    dmr_route_group_t *group = dmr_route_group(talkgroup, timeslot, false);
+    
+    if (group == NULL) {
+        *count = 0;
+        return NULL;
+    }
+    
+    *count = group->count;
+    return group->members;
+}
+
+/* Drop expired dynamic subscriptions of the next DMR_EXPIRE_SLICE client
+ * slots; returns the number of slots looked at, less than a full slice once
+ * the sweep has wrapped round */
+int dmr_route_expire(uint64_t now) {
+    uint32_t capacity = (uint32_t)dmr_clients_capacity();
+    int scanned = 0;
+    int k;
+    
+    while (expire_cursor < capacity && scanned < DMR_EXPIRE_SLICE) {
+        dmr_client_t *client = dmr_clients_slot(expire_cursor++);
+        
+        scanned++;
+        if (!client->active) {
+            continue;
+        }
+        for (k = client->sub_count - 1; k >= 0; k--) {
+            if (!client->subs[k].is_static && client->subs[k].expires <= now) {
+                dmr_route_drop(client, k);
+            }
+        }
+    }
+    
+    if (scanned < DMR_EXPIRE_SLICE) {
+        expire_cursor = 0;
+    }
+    
+    return scanned;
+}
+
+/* Parse a static subscription written as ID:TG[:SLOT] */
+int dmr_route_parse_static(const char *spec, dmr_static_sub_t *sub) {
+    unsigned int dmr_id, talkgroup, timeslot = 0;
+    int fields = sscanf(spec, "%u:%u:%u", &dmr_id, &talkgroup, &timeslot);
+    
+    if (fields < 2 || dmr_id == 0 || !dmr_route_valid_talkgroup(talkgroup) || timeslot > DMR_SLOT_2) {
+        return -1;
+    }
+    
+    sub->dmr_id = dmr_id;
+    sub->talkgroup = talkgroup;
+    sub->timeslot = (uint8_t)timeslot;
+    
+    return 0;
+}
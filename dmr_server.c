@@ -8,416 +8,1879 @@
 
 #include "dmr_server.h"
 
+#ifdef DMR_HAVE_URING
+/* io_uring send in flight; the frame bytes stay in a pooled buffer it holds */
+typedef struct {
+    struct msghdr msg;                  /* Points at addr and iov */
+    struct iovec iov;
+    struct sockaddr_in addr;            /* Recipient */
+    uint64_t started;                   /* frame_nsec of the frame sent */
+    dmr_frame_buf_t *frame;             /* Pooled copy of the frame */
+    uint8_t marks;                      /* DMR_TX_FIRST/DMR_TX_LAST of a frame's fan-out */
+} dmr_uring_send_t;
+
+/* io_uring backend state of one worker */
+typedef struct {
+    dmr_uring_t ring;
+    struct msghdr rx_msg;               /* Multishot recvmsg layout: source address, no control data */
+    dmr_frame_pool_t pool;              /* Frame copies for the sends in flight */
+    dmr_frame_buf_t *frame;             /* Pooled copy of the frame being relayed, NULL until its first send */
+    const struct sockaddr_in *frame_source;  /* Sender of the frame being relayed */
+    dmr_uring_send_t sends[DMR_URING_SENDS];
+    uint16_t free_sends[DMR_URING_SENDS];  /* Stack of unused send slots */
+    int free_count;
+    int last_send;                      /* Slot of the frame's latest queued send, -1 if sent inline */
+} dmr_uring_io_t;
+#endif
+
+/* Per-worker receive and send state */
+typedef struct {
+    int id;                             /* Worker index */
+    int socket;                         /* This worker's SO_REUSEPORT socket */
+    dmr_stats_t *stats;                 /* This worker's counters */
+    dmr_latency_t *latency;             /* This worker's DMR_LAT_* histograms */
+    uint64_t rx_nsec;                   /* When the last receive call returned */
+    uint64_t frame_nsec;                /* When processing of the current frame began */
+#ifdef DMR_HAVE_MMSG
+    /* Receive batch buffers, preallocated once for recvmmsg() */
+    uint8_t rx_buffers[DMR_MAX_BATCH][DMR_BUFFER_SIZE];
+    struct sockaddr_in rx_addrs[DMR_MAX_BATCH];
+    struct iovec rx_iovecs[DMR_MAX_BATCH];
+    struct mmsghdr rx_msgs[DMR_MAX_BATCH];
+    
+    /* Fan-out queue, flushed with sendmmsg() once per frame or receive batch;
+     * the iovecs point into rx_buffers, which are not reused before the flush */
+    struct sockaddr_in tx_addrs[DMR_TX_QUEUE_SIZE];
+    struct iovec tx_iovecs[DMR_TX_QUEUE_SIZE];
+    struct mmsghdr tx_msgs[DMR_TX_QUEUE_SIZE];
+    uint64_t tx_started[DMR_TX_QUEUE_SIZE];  /* frame_nsec of each queued message's frame */
+    uint8_t tx_marks[DMR_TX_QUEUE_SIZE];     /* DMR_TX_FIRST/DMR_TX_LAST of a frame's fan-out */
+    int tx_count;
+    bool tx_deferred;                   /* Hold sends until the receive batch ends */
+#endif
+#ifdef DMR_HAVE_EPOLL
+    int epoll_fd;                       /* Socket, timer and stop events */
+    int timer_fd;                       /* Housekeeping tick, worker 0 only, -1 otherwise */
+#endif
+#ifdef DMR_HAVE_URING
+    dmr_uring_io_t *uring;              /* io_uring backend, NULL on the socket backend */
+#endif
+} dmr_worker_t;
+
+/* Fan-out queue marks for latency measurement */
+#define DMR_TX_FIRST            0x01    /* First message queued for a frame */
+#define DMR_TX_LAST             0x02    /* Last message queued for a frame */
+
+/* Event loop sources */
+#define DMR_EVENT_SOCKET        0       /* Datagrams queued on the worker socket */
+#define DMR_EVENT_TIMER         1       /* Housekeeping tick */
+#define DMR_EVENT_STOP          2       /* Server stopping */
+#define DMR_EVENT_SEND          3       /* io_uring send completed, slot in the upper bits */
+#define DMR_EVENT_BITS          8       /* Low bits of io_uring user data holding the source */
+
 /* Global variables */
-static int server_socket = -1;
-static dmr_client_t clients[DMR_MAX_CLIENTS];
-static int client_count = 0;
+static dmr_worker_t *workers = NULL;
+static int worker_count = 0;
+static __thread dmr_worker_t *current_worker = NULL;
+static dmr_rwlock_t clients_lock = DMR_RWLOCK_INITIALIZER;
 static dmr_config_t server_config;
+static dmr_wheel_t timeout_wheel;       /* Client inactivity timers, under clients_lock */
+static dmr_wheel_t call_wheel;          /* Call timeout and hang timers, under clients_lock */
+static int clients_published = 0;       /* Client count for readers that must not take clients_lock */
+static int server_stopping = 0;         /* Set once by dmr_server_stop() */
+#ifdef DMR_HAVE_EPOLL
+static int stop_fd = -1;                /* eventfd, left readable to wake every worker on stop */
+#endif
+
+/* Per-thread clock, refreshed once per receive batch */
+static __thread uint64_t clock_now = 0;  /* Monotonic milliseconds */
+static __thread time_t clock_wall = 0;   /* Wall clock seconds */
+
+/* Close a socket */
+static void dmr_close_socket(int sock) {
+#ifdef _WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+}
+
+/* Refresh the calling thread's cached clock; returns monotonic milliseconds */
+uint64_t dmr_clock_update(void) {
+#ifdef _WIN32
+    clock_now = GetTickCount64();
+    clock_wall = time(NULL);
+#else
+    struct timespec ts;
+    
+    clock_gettime(DMR_CLOCK_MONOTONIC, &ts);
+    clock_now = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    clock_gettime(DMR_CLOCK_REALTIME, &ts);
+    clock_wall = ts.tv_sec;
+#endif
+    return clock_now;
+}
+
+/* The calling thread's cached monotonic clock in milliseconds */
+uint64_t dmr_clock_now(void) {
+    return clock_now;
+}
+
+/* The calling thread's cached wall clock */
+time_t dmr_clock_wall(void) {
+    return clock_wall;
+}
+
+/* Tick at which a client seen at last_seen has timed out */
+static uint64_t dmr_timeout_tick(uint64_t last_seen) {
+    return (last_seen + (uint64_t)server_config.timeout * 1000) / DMR_TIMER_TICK_MS + 1;
+}
+
+#ifndef DMR_HAVE_EPOLL
+/* Make receive calls on a socket give up after a number of milliseconds */
+static void dmr_set_receive_timeout(int sock, int ms) {
+#ifdef _WIN32
+    DWORD timeout = ms;
+#else
+    struct timeval timeout;
+    timeout.tv_sec = ms / 1000;
+    timeout.tv_usec = (ms % 1000) * 1000;
+#endif
+    
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout)) < 0) {
+        perror("Failed to set SO_RCVTIMEO");
+    }
+}
+#endif
+
+/* Create and bind one UDP socket for the server port */
+static int dmr_open_socket(struct sockaddr_in *server_addr, bool reuseport) {
+    int sock;
+    
+    /* Create UDP socket */
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+#ifdef _WIN32
+        fprintf(stderr, "Failed to create socket: %d\n", WSAGetLastError());
+#else
+        perror("Failed to create socket");
+#endif
+        return -1;
+    }
+    
+#ifdef DMR_HAVE_REUSEPORT
+    /* Let every worker bind its own socket to the same port */
+    if (reuseport) {
+        int on = 1;
+        if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+            perror("Failed to set SO_REUSEPORT");
+            close(sock);
+            return -1;
+        }
+    }
+#else
+    (void)reuseport;
+#endif
+    
+    /* Bind socket */
+    if (bind(sock, (struct sockaddr *)server_addr, sizeof(*server_addr)) < 0) {
+#ifdef _WIN32
+        fprintf(stderr, "Failed to bind socket: %d\n", WSAGetLastError());
+#else
+        perror("Failed to bind socket");
+#endif
+        dmr_close_socket(sock);
+        return -1;
+    }
+    
+    return sock;
+}
+
+#ifdef DMR_HAVE_SOCKET_FILTER
+/* Attach a classic BPF program that drops, before they are queued, datagrams
+ * too short for a frame header, larger than the receive buffer, or of a
+ * packet type outside DMR_PKT_VOICE..DMR_PKT_SYNC. The program sees the UDP
+ * header, so the payload starts at offset 8. */
+static int dmr_attach_filter(int sock) {
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+        BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 8 + DMR_FRAME_HEADER_SIZE, 0, 5),
+        BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, 8 + DMR_BUFFER_SIZE, 4, 0),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 8),
+        BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, DMR_PKT_VOICE, 0, 2),
+        BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, DMR_PKT_SYNC, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF),  /* Accept whole */
+        BPF_STMT(BPF_RET | BPF_K, 0),           /* Drop */
+    };
+    struct sock_fprog program;
+    
+    program.len = sizeof(code) / sizeof(code[0]);
+    program.filter = code;
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) < 0) {
+        perror("Failed to attach socket filter");
+        return -1;
+    }
+    
+    return 0;
+}
+#endif
+
+#ifdef DMR_HAVE_STEERING
+/* Attach a reuseport program that sends each source to the same worker
+ * socket, by address and port or by the frame's source DMR ID (bytes 2-4
+ * of the payload, which the program sees from offset 0). The key is mixed
+ * before the modulo so clustered IDs and ports still spread evenly.
+ * Sockets are indexed in bind order, which is worker order. */
+static int dmr_attach_steering(int sock, int steering, int workers) {
+    struct sock_filter by_peer[] = {
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, SKF_NET_OFF),      /* X = IP header length */
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, SKF_NET_OFF),       /* A = UDP source port */
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),  /* A = IP source address */
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x9E3779B1),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)workers),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sock_filter by_src_id[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 2),                 /* Runts fail here and go to worker 0 */
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 8),                /* A = source DMR ID */
+        BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x9E3779B1),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)workers),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sock_fprog program;
+    
+    if (steering == DMR_STEER_PEER) {
+        program.len = sizeof(by_peer) / sizeof(by_peer[0]);
+        program.filter = by_peer;
+    } else {
+        program.len = sizeof(by_src_id) / sizeof(by_src_id[0]);
+        program.filter = by_src_id;
+    }
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0) {
+        perror("Failed to attach reuseport steering program");
+        return -1;
+    }
+    
+    return 0;
+}
+#endif
+
+#ifdef DMR_HAVE_MMSG
+/* Point the worker's receive and send vectors at their buffers */
+static void dmr_worker_setup_vectors(dmr_worker_t *worker) {
+    int i;
+    
+    /* Point each receive message at its own buffer and address */
+    for (i = 0; i < DMR_MAX_BATCH; i++) {
+        worker->rx_iovecs[i].iov_base = worker->rx_buffers[i];
+        worker->rx_iovecs[i].iov_len = DMR_BUFFER_SIZE;
+        worker->rx_msgs[i].msg_hdr.msg_name = &worker->rx_addrs[i];
+        worker->rx_msgs[i].msg_hdr.msg_iov = &worker->rx_iovecs[i];
+        worker->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    
+    /* Point each send message at its own address and frame reference */
+    for (i = 0; i < DMR_TX_QUEUE_SIZE; i++) {
+        worker->tx_msgs[i].msg_hdr.msg_name = &worker->tx_addrs[i];
+        worker->tx_msgs[i].msg_hdr.msg_namelen = sizeof(worker->tx_addrs[i]);
+        worker->tx_msgs[i].msg_hdr.msg_iov = &worker->tx_iovecs[i];
+        worker->tx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+#endif
+
+#ifdef DMR_HAVE_EPOLL
+/* Add a descriptor to a worker's event loop */
+static int dmr_worker_watch(dmr_worker_t *worker, int fd, uint32_t source) {
+    struct epoll_event event;
+    
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = source;
+    return epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/* Set up a worker's event loop: its socket made non-blocking, the stop
+ * eventfd and, on worker 0, the housekeeping timer */
+static int dmr_worker_setup_events(dmr_worker_t *worker) {
+    struct itimerspec tick;
+    
+    worker->timer_fd = -1;
+    worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (worker->epoll_fd < 0) {
+        perror("Failed to create epoll instance");
+        return -1;
+    }
+    
+    if (fcntl(worker->socket, F_SETFL, fcntl(worker->socket, F_GETFL) | O_NONBLOCK) < 0 ||
+        dmr_worker_watch(worker, worker->socket, DMR_EVENT_SOCKET) < 0 ||
+        dmr_worker_watch(worker, stop_fd, DMR_EVENT_STOP) < 0) {
+        perror("Failed to set up worker events");
+        return -1;
+    }
+    
+    if (worker->id == 0) {
+        worker->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (worker->timer_fd < 0) {
+            perror("Failed to create housekeeping timer");
+            return -1;
+        }
+        
+        tick.it_interval.tv_sec = DMR_TIMER_TICK_MS / 1000;
+        tick.it_interval.tv_nsec = (DMR_TIMER_TICK_MS % 1000) * 1000000L;
+        tick.it_value = tick.it_interval;
+        if (timerfd_settime(worker->timer_fd, 0, &tick, NULL) < 0 ||
+            dmr_worker_watch(worker, worker->timer_fd, DMR_EVENT_TIMER) < 0) {
+            perror("Failed to start housekeeping timer");
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+/* Close a worker's event loop descriptors */
+static void dmr_worker_close_events(dmr_worker_t *worker) {
+    if (worker->timer_fd >= 0) {
+        close(worker->timer_fd);
+        worker->timer_fd = -1;
+    }
+    if (worker->epoll_fd >= 0) {
+        close(worker->epoll_fd);
+        worker->epoll_fd = -1;
+    }
+}
+#endif
 
-/* Statistics */
-static uint64_t packets_received = 0;
-static uint64_t packets_relayed = 0;
-static uint64_t bytes_received = 0;
-static uint64_t bytes_sent = 0;
+#ifdef DMR_HAVE_URING
+/* Set up a worker's io_uring backend: its ring, with receive buffers large
+ * enough for the recvmsg header, the source address and a datagram */
+static int dmr_worker_setup_uring(dmr_worker_t *worker) {
+    dmr_uring_io_t *io;
+    int i;
+
+    io = calloc(1, sizeof(dmr_uring_io_t));
+    if (io == NULL) {
+        fprintf(stderr, "Failed to allocate io_uring state\n");
+        return -1;
+    }
+    if (dmr_pool_init(&io->pool, DMR_POOL_FRAMES) != 0) {
+        free(io);
+        return -1;
+    }
+    if (dmr_uring_init(&io->ring, DMR_URING_ENTRIES, DMR_URING_BUFFERS,
+                       sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + DMR_BUFFER_SIZE) != 0) {
+        dmr_pool_cleanup(&io->pool);
+        free(io);
+        return -1;
+    }
+
+    io->rx_msg.msg_namelen = sizeof(struct sockaddr_in);
+    for (i = 0; i < DMR_URING_SENDS; i++) {
+        io->sends[i].msg.msg_name = &io->sends[i].addr;
+        io->sends[i].msg.msg_namelen = sizeof(io->sends[i].addr);
+        io->sends[i].msg.msg_iov = &io->sends[i].iov;
+        io->sends[i].msg.msg_iovlen = 1;
+        io->free_sends[i] = (uint16_t)(DMR_URING_SENDS - 1 - i);
+    }
+    io->free_count = DMR_URING_SENDS;
+    io->last_send = -1;
+
+    worker->uring = io;
+    return 0;
+}
+
+/* Release a worker's io_uring backend; sends still in flight are cancelled */
+static void dmr_worker_close_uring(dmr_worker_t *worker) {
+    if (worker->uring != NULL) {
+        dmr_uring_cleanup(&worker->uring->ring);
+        dmr_pool_cleanup(&worker->uring->pool);
+        free(worker->uring);
+        worker->uring = NULL;
+    }
+}
+#endif
 
 /* Initialize the DMR server */
 int dmr_server_init(dmr_config_t *config) {
     int i;
     
-#ifdef _WIN32
-    WSADATA wsa_data;
-    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
-        fprintf(stderr, "Failed to initialize Winsock\n");
-        return -1;
+#ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        fprintf(stderr, "Failed to initialize Winsock\n");
+        return -1;
+    }
+#endif
+    
+    /* Copy configuration */
+    memcpy(&server_config, config, sizeof(dmr_config_t));
+    
+    /* Clamp receive batch size */
+    if (server_config.batch_size < 1) {
+        server_config.batch_size = 1;
+    } else if (server_config.batch_size > DMR_MAX_BATCH) {
+        server_config.batch_size = DMR_MAX_BATCH;
+    }
+#ifndef DMR_HAVE_MMSG
+    server_config.batch_size = 1;
+#endif
+    
+    /* Clamp call timing; a call must survive the gap between two bursts */
+    if (server_config.call_hang_ms < 0) {
+        server_config.call_hang_ms = 0;
+    } else if (server_config.call_hang_ms > DMR_CALL_MAX_MS) {
+        server_config.call_hang_ms = DMR_CALL_MAX_MS;
+    }
+    if (server_config.call_timeout_ms < DMR_SLOT_TIME_MS) {
+        server_config.call_timeout_ms = DMR_SLOT_TIME_MS;
+    } else if (server_config.call_timeout_ms > DMR_CALL_MAX_MS) {
+        server_config.call_timeout_ms = DMR_CALL_MAX_MS;
+    }
+    config->call_hang_ms = server_config.call_hang_ms;
+    config->call_timeout_ms = server_config.call_timeout_ms;
+    
+    /* Pick the number of receive workers */
+#ifdef DMR_HAVE_REUSEPORT
+    if (server_config.workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        server_config.workers = cpus > 0 ? (int)cpus : 1;
+    }
+    if (server_config.workers > DMR_MAX_WORKERS) {
+        server_config.workers = DMR_MAX_WORKERS;
+    }
+#else
+    server_config.workers = 1;
+#endif
+    config->workers = server_config.workers;
+    
+    /* Initialize client registry and talkgroup routing */
+    if (dmr_clients_init(server_config.max_clients) != 0) {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return -1;
+    }
+    if (dmr_route_init(&server_config) != 0) {
+        dmr_clients_cleanup();
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return -1;
+    }
+    dmr_wheel_init(&timeout_wheel, dmr_clock_update() / DMR_TIMER_TICK_MS);
+    dmr_wheel_init(&call_wheel, dmr_clock_now() / DMR_TIMER_TICK_MS);
+    
+    /* Initialize database if enabled; all queries run on the writer thread */
+    if (config->db.enabled) {
+        if (dmr_db_init(&config->db) != 0) {
+            fprintf(stderr, "Warning: Failed to initialize database connection\n");
+            /* Continue without database */
+            server_config.db.enabled = false;
+        } else if (dmr_callsign_init(config->db.callsign_cache, config->db.callsign_negative_ttl) != 0 ||
+                   dmr_db_writer_start(&config->db) != 0) {
+            fprintf(stderr, "Warning: Failed to start database writer\n");
+            server_config.db.enabled = false;
+        } else {
+            /* Fill the callsign cache before the first client connects */
+            int loaded = dmr_db_load_callsigns(0);
+            if (loaded >= 0) {
+                printf("Loaded %d callsigns\n", loaded);
+            }
+        }
+    }
+    
+    /* Set up server address */
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(config->port);
+    
+    if (config->bind_addr) {
+        if (inet_pton(AF_INET, config->bind_addr, &server_addr.sin_addr) <= 0) {
+            fprintf(stderr, "Invalid bind address: %s\n", config->bind_addr);
+#ifdef _WIN32
+            WSACleanup();
+#endif
+            return -1;
+        }
+    } else {
+        server_addr.sin_addr.s_addr = INADDR_ANY;
+    }
+    
+    /* Allocate workers and their counters */
+    workers = calloc(server_config.workers, sizeof(dmr_worker_t));
+    if (workers == NULL) {
+        fprintf(stderr, "Failed to allocate %d workers\n", server_config.workers);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return -1;
+    }
+    dmr_stats_init(server_config.workers);
+    __atomic_store_n(&server_stopping, 0, __ATOMIC_RELAXED);
+    
+#ifdef DMR_HAVE_EPOLL
+    /* One stop eventfd is shared by every worker's event loop */
+    stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stop_fd < 0) {
+        perror("Failed to create stop eventfd");
+        free(workers);
+        workers = NULL;
+        return -1;
+    }
+#endif
+    
+    /* Open one socket per worker, all bound to the same port */
+    for (i = 0; i < server_config.workers; i++) {
+        workers[i].id = i;
+        workers[i].stats = dmr_stats_worker(i);
+        workers[i].latency = dmr_stats_latency(i);
+        workers[i].socket = dmr_open_socket(&server_addr, server_config.workers > 1);
+#ifdef DMR_HAVE_SOCKET_FILTER
+        /* The filter is an optimization; without it userspace still rejects runts */
+        if (workers[i].socket >= 0 && server_config.kernel_filter && dmr_attach_filter(workers[i].socket) != 0) {
+            fprintf(stderr, "Warning: Receiving unfiltered on worker %d\n", i);
+        }
+#endif
+#ifdef DMR_HAVE_EPOLL
+        if (workers[i].socket >= 0 && dmr_worker_setup_events(&workers[i]) != 0) {
+            dmr_worker_close_events(&workers[i]);
+            dmr_close_socket(workers[i].socket);
+            workers[i].socket = -1;
+        }
+#endif
+        if (workers[i].socket < 0) {
+            while (--i >= 0) {
+#ifdef DMR_HAVE_EPOLL
+                dmr_worker_close_events(&workers[i]);
+#endif
+                dmr_close_socket(workers[i].socket);
+            }
+#ifdef DMR_HAVE_EPOLL
+            close(stop_fd);
+            stop_fd = -1;
+#endif
+            free(workers);
+            workers = NULL;
+#ifdef _WIN32
+            WSACleanup();
+#endif
+            return -1;
+        }
+#ifdef DMR_HAVE_MMSG
+        dmr_worker_setup_vectors(&workers[i]);
+#endif
+    }
+    worker_count = server_config.workers;
+    
+    /* The program applies to the whole reuseport group, so attach it once every socket is bound */
+    if (server_config.steering != DMR_STEER_HASH && worker_count > 1) {
+#ifdef DMR_HAVE_STEERING
+        if (dmr_attach_steering(workers[0].socket, server_config.steering, worker_count) != 0) {
+            fprintf(stderr, "Warning: Falling back to the kernel's reuseport hash\n");
+            server_config.steering = DMR_STEER_HASH;
+        }
+#else
+        fprintf(stderr, "Warning: Reuseport steering is not supported on this platform\n");
+        server_config.steering = DMR_STEER_HASH;
+#endif
+    }
+    config->steering = server_config.steering;
+
+    /* io_uring needs a recent kernel; any worker failing sends all back to system calls */
+    if (server_config.io_backend == DMR_IO_URING) {
+#ifdef DMR_HAVE_URING
+        for (i = 0; i < worker_count; i++) {
+            if (dmr_worker_setup_uring(&workers[i]) != 0) {
+                while (--i >= 0) {
+                    dmr_worker_close_uring(&workers[i]);
+                }
+                fprintf(stderr, "Warning: Falling back to the socket I/O backend\n");
+                server_config.io_backend = DMR_IO_SOCKET;
+                break;
+            }
+        }
+#else
+        fprintf(stderr, "Warning: io_uring is not supported on this platform\n");
+        server_config.io_backend = DMR_IO_SOCKET;
+#endif
+    }
+    config->io_backend = server_config.io_backend;
+#ifndef DMR_HAVE_SOCKET_FILTER
+    if (server_config.kernel_filter) {
+        fprintf(stderr, "Warning: Kernel filtering is not supported on this platform\n");
+        server_config.kernel_filter = false;
+    }
+#endif
+    
+#ifndef DMR_HAVE_EPOLL
+    /* Without an event loop, wake every worker at least once a second so
+     * timeouts fire while idle and a stop is noticed */
+    for (i = 0; i < worker_count; i++) {
+        dmr_set_receive_timeout(workers[i].socket, 1000);
+    }
+#endif
+    
+    /* Serve metrics from snapshots on a thread of its own */
+    if (server_config.metrics_port > 0 && dmr_metrics_start(&server_config) != 0) {
+        fprintf(stderr, "Warning: Failed to start metrics listener\n");
+    }
+    
+    printf("DMR Voice Relay Server initialized on port %d\n", config->port);
+    return 0;
+}
+
+/* Number of receive workers started by dmr_server_init() */
+int dmr_server_worker_count(void) {
+    return worker_count;
+}
+
+/* Handle a single received datagram */
+static void dmr_handle_datagram(dmr_worker_t *worker, uint8_t *buffer, int bytes_read,
+                                struct sockaddr_in *client_addr) {
+    dmr_stats_t *stats = worker->stats;
+    dmr_frame_view_t frame;
+    uint8_t type, slot;
+    
+    /* Time spent waiting behind earlier datagrams of the batch */
+    worker->frame_nsec = dmr_stats_clock();
+    dmr_latency_record(&worker->latency[DMR_LAT_RECV_PROCESS], worker->frame_nsec - worker->rx_nsec);
+    
+    /* Update statistics */
+    DMR_STATS_ADD(stats, packets_received, 1);
+    DMR_STATS_ADD(stats, bytes_received, bytes_read);
+    
+    /* Process received data in place, the relay forwards these same bytes */
+    if (dmr_frame_view_init(&frame, buffer, bytes_read) != 0) {
+        DMR_STATS_ADD(stats, errors[DMR_ERR_RUNT], 1);
+        return;
+    }
+    if (bytes_read > DMR_FRAME_SIZE) {
+        DMR_STATS_ADD(stats, errors[DMR_ERR_TRUNCATED], 1);
+    }
+    
+    type = dmr_frame_type(&frame);
+    slot = dmr_frame_slot(&frame);
+    DMR_STATS_ADD(stats, frames_by_type[type >= DMR_PKT_VOICE && type <= DMR_PKT_SYNC ? type : 0], 1);
+    DMR_STATS_ADD(stats, frames_by_slot[slot == DMR_SLOT_1 || slot == DMR_SLOT_2 ? slot : 0], 1);
+    
+    /* Process frame */
+    dmr_process_frame(&frame, client_addr);
+    
+    /* Relay frame to other clients */
+    dmr_relay_frame(&frame, client_addr);
+}
+
+/* Record the size of a receive batch */
+static void dmr_record_batch(dmr_worker_t *worker, int count) {
+    int bucket = 0;
+    
+    /* Bucket by power of two: 1, 2-3, 4-7, ... */
+    while (count > 1 && bucket < DMR_BATCH_HIST_BUCKETS - 1) {
+        count >>= 1;
+        bucket++;
+    }
+    DMR_STATS_ADD(worker->stats, batch_hist[bucket], 1);
+}
+
+/* Run periodic housekeeping; returns true while timed out clients remain to be expired */
+static bool dmr_housekeeping(void) {
+    static uint64_t last_cleanup = 0;
+    static uint64_t last_tick = 0;
+    static bool expire_more = false;
+    static bool sweep_routes = false;
+    uint64_t now = dmr_clock_now();
+    
+    /* Expire timed out clients once a tick, continuing while a slice comes back full */
+    if (now / DMR_TIMER_TICK_MS != last_tick || expire_more) {
+        last_tick = now / DMR_TIMER_TICK_MS;
+        expire_more = dmr_cleanup_clients() == DMR_EXPIRE_SLICE;
+        expire_more |= dmr_expire_calls() == DMR_EXPIRE_SLICE;
+        
+        /* Sweep dynamic talkgroup subscriptions a slice of clients at a time,
+         * so other workers get the lock between slices */
+        if (sweep_routes) {
+            dmr_rwlock_wrlock(&clients_lock);
+            sweep_routes = dmr_route_expire(now) == DMR_EXPIRE_SLICE;
+            dmr_rwlock_wrunlock(&clients_lock);
+            expire_more |= sweep_routes;
+        }
+    }
+    
+    if (now - last_cleanup > 60000) { /* Clean up every minute */
+        last_cleanup = now;
+        
+        /* Start a sweep of expired dynamic talkgroup subscriptions */
+        sweep_routes = true;
+        
+        /* Print statistics */
+        if (server_config.verbose) {
+            dmr_print_stats();
+        }
+    }
+    
+    return expire_more;
+}
+
+/* Report and count a receive error unless it is transient */
+static void dmr_receive_failed(dmr_worker_t *worker) {
+#ifdef _WIN32
+    int err = WSAGetLastError();
+    if (err == WSAEWOULDBLOCK || err == WSAEINTR || err == WSAETIMEDOUT) {
+        return;
+    }
+    fprintf(stderr, "Error receiving data: %d\n", err);
+#else
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        return;
+    }
+    perror("Error receiving data");
+#endif
+    DMR_STATS_ADD(worker->stats, errors[DMR_ERR_RECV], 1);
+}
+
+#ifdef DMR_HAVE_MMSG
+/* Drain up to batch_size datagrams with a single recvmmsg() call */
+static int dmr_receive_batch(dmr_worker_t *worker) {
+    int i;
+    int count;
+    
+    /* recvmmsg() overwrites the address length, so reset it each call */
+    for (i = 0; i < server_config.batch_size; i++) {
+        worker->rx_msgs[i].msg_hdr.msg_namelen = sizeof(worker->rx_addrs[i]);
+    }
+    
+    /* Block for the first datagram, then take whatever else is queued */
+    count = recvmmsg(worker->socket, worker->rx_msgs, server_config.batch_size, MSG_WAITFORONE, NULL);
+    worker->rx_nsec = dmr_stats_clock();
+    dmr_clock_update();
+    if (count <= 0) {
+        if (count < 0) {
+            dmr_receive_failed(worker);
+        }
+        return count;
+    }
+    
+    dmr_record_batch(worker, count);
+    
+    /* Accumulate the fan-out of the whole batch and send it together */
+    worker->tx_deferred = true;
+    for (i = 0; i < count; i++) {
+        dmr_handle_datagram(worker, worker->rx_buffers[i], (int)worker->rx_msgs[i].msg_len,
+                            &worker->rx_addrs[i]);
+    }
+    worker->tx_deferred = false;
+    dmr_relay_flush();
+    
+    return count;
+}
+#endif
+
+/* Receive and handle one datagram with recvfrom(); returns 1, or -1 on failure */
+static int dmr_receive_one(dmr_worker_t *worker) {
+    struct sockaddr_in client_addr;
+    socklen_t addr_len = sizeof(client_addr);
+    uint8_t buffer[DMR_BUFFER_SIZE];
+    int bytes_read;
+    
+    bytes_read = recvfrom(worker->socket, (char *)buffer, DMR_BUFFER_SIZE, 0, 
+                         (struct sockaddr *)&client_addr, &addr_len);
+    worker->rx_nsec = dmr_stats_clock();
+    dmr_clock_update();
+    
+    if (bytes_read < 0) {
+        dmr_receive_failed(worker);
+        return -1;
+    }
+    
+    dmr_record_batch(worker, 1);
+    dmr_handle_datagram(worker, buffer, bytes_read, &client_addr);
+    return 1;
+}
+
+/* Receive one batch, or one datagram when batching is off; returns the number handled */
+static int dmr_receive(dmr_worker_t *worker) {
+#ifdef DMR_HAVE_MMSG
+    if (server_config.batch_size > 1) {
+        return dmr_receive_batch(worker);
+    }
+#endif
+    return dmr_receive_one(worker);
+}
+
+#ifdef DMR_HAVE_EPOLL
+/* Event loop of one worker: drain the socket while it is readable, run
+ * housekeeping on each timer tick and return once the stop eventfd fires */
+static void dmr_worker_loop(dmr_worker_t *worker) {
+    struct epoll_event events[3];
+    bool expire_more = false;
+    bool tick;
+    uint64_t expirations;
+    int count;
+    int i, n;
+    
+    while (1) {
+        /* Carry on expiring without waiting for the next tick while slices come back full */
+        count = epoll_wait(worker->epoll_fd, events, 3, expire_more ? 0 : -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to wait for events");
+            return;
+        }
+        
+        tick = expire_more;
+        for (i = 0; i < count; i++) {
+            switch (events[i].data.u32) {
+            case DMR_EVENT_STOP:
+                return;
+            
+            case DMR_EVENT_SOCKET:
+                /* A short batch means the queue is empty; a long backlog waits for the next turn */
+                for (n = 0; n < DMR_DRAIN_CALLS; n++) {
+                    if (dmr_receive(worker) < server_config.batch_size) {
+                        break;
+                    }
+                }
+                break;
+            
+            case DMR_EVENT_TIMER:
+                if (read(worker->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                    tick = true;
+                }
+                break;
+            }
+        }
+        
+        if (tick) {
+            dmr_clock_update();
+            expire_more = dmr_housekeeping();
+        }
+    }
+}
+#endif
+
+#ifdef DMR_HAVE_URING
+/* Handle a datagram a multishot recvmsg placed in a provided buffer. Its
+ * sends hold a pooled copy of the frame, so the buffer goes straight back. */
+static void dmr_uring_receive(dmr_worker_t *worker, unsigned bid) {
+    dmr_uring_io_t *io = worker->uring;
+    uint8_t *buffer = dmr_uring_buffer(&io->ring, bid);
+    struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buffer;
+    struct sockaddr_in *client_addr = (struct sockaddr_in *)(buffer + sizeof(*out));
+    uint8_t *payload = buffer + sizeof(*out) + io->rx_msg.msg_namelen + io->rx_msg.msg_controllen;
+    int length = out->payloadlen > DMR_BUFFER_SIZE ? DMR_BUFFER_SIZE : (int)out->payloadlen;
+
+    io->frame = NULL;
+    io->frame_source = client_addr;
+    dmr_handle_datagram(worker, payload, length, client_addr);
+    if (io->frame != NULL) {
+        dmr_pool_release(&io->pool, io->frame);
+        io->frame = NULL;
+    }
+    dmr_uring_buffer_return(&io->ring, bid);
+}
+
+/* Account for a completed send and free its slot */
+static void dmr_uring_send_done(dmr_worker_t *worker, unsigned slot, int result) {
+    dmr_uring_io_t *io = worker->uring;
+    dmr_uring_send_t *send = &io->sends[slot];
+    uint64_t now = dmr_stats_clock();
+
+    if (result < 0) {
+        fprintf(stderr, "Failed to send to client: %s\n", strerror(-result));
+        DMR_STATS_ADD(worker->stats, errors[DMR_ERR_SEND], 1);
+    } else {
+        DMR_STATS_ADD(worker->stats, bytes_sent, result);
+        DMR_STATS_ADD(worker->stats, packets_relayed, 1);
+        if (send->marks & DMR_TX_FIRST) {
+            dmr_latency_record(&worker->latency[DMR_LAT_FIRST_SEND], now - send->started);
+        }
+        if (send->marks & DMR_TX_LAST) {
+            dmr_latency_record(&worker->latency[DMR_LAT_LAST_SEND], now - send->started);
+        }
+    }
+
+    dmr_pool_release(&io->pool, send->frame);
+    io->free_sends[io->free_count++] = (uint16_t)slot;
+}
+
+/* Event loop of one worker on io_uring: a multishot recvmsg on the socket
+ * and multishot polls on the stop eventfd and housekeeping timer. Each pass
+ * submits the previous pass's fan-out, waits for completions and handles
+ * them all. Receive buffers go back to the kernel as soon as a datagram is
+ * handled; its fan-out sends from a pooled copy. */
+static void dmr_uring_loop(dmr_worker_t *worker) {
+    dmr_uring_io_t *io = worker->uring;
+    struct io_uring_cqe *cqe;
+    bool expire_more = false;
+    bool tick, rearm_recv, rearm_timer;
+    uint64_t user_data, expirations;
+    uint32_t flags;
+    int result;
+    int received;
+
+    if (dmr_uring_recv_multishot(&io->ring, worker->socket, &io->rx_msg, DMR_EVENT_SOCKET) != 0 ||
+        dmr_uring_poll_multishot(&io->ring, stop_fd, DMR_EVENT_STOP) != 0 ||
+        (worker->timer_fd >= 0 && dmr_uring_poll_multishot(&io->ring, worker->timer_fd, DMR_EVENT_TIMER) != 0)) {
+        fprintf(stderr, "Failed to queue worker events\n");
+        return;
+    }
+
+    while (1) {
+        /* Carry on expiring without waiting for the next tick while slices come back full */
+        if (dmr_uring_submit(&io->ring, expire_more ? 0 : 1) < 0 && errno != EINTR && errno != EBUSY) {
+            perror("Failed to wait for io_uring completions");
+            return;
+        }
+        worker->rx_nsec = dmr_stats_clock();
+        dmr_clock_update();
+
+        tick = expire_more;
+        rearm_recv = false;
+        rearm_timer = false;
+        received = 0;
+
+        /* Hold sends until every completion of this pass is handled */
+        worker->tx_deferred = true;
+        while ((cqe = dmr_uring_cqe(&io->ring)) != NULL) {
+            user_data = cqe->user_data;
+            flags = cqe->flags;
+            result = cqe->res;
+            dmr_uring_cqe_seen(&io->ring);
+
+            switch (user_data & ((1u << DMR_EVENT_BITS) - 1)) {
+            case DMR_EVENT_STOP:
+                worker->tx_deferred = false;
+                return;
+
+            case DMR_EVENT_SOCKET:
+                rearm_recv |= !(flags & IORING_CQE_F_MORE);
+                if (result < 0) {
+                    /* Out of buffers: buffers go back as each datagram is handled, so this
+                     * only happens when a burst outruns the ring within one pass. The
+                     * multishot recvmsg ends with it and is rearmed at the end of the pass. */
+                    if (result != -ENOBUFS) {
+                        errno = -result;
+                        dmr_receive_failed(worker);
+                    }
+                } else if (flags & IORING_CQE_F_BUFFER) {
+                    dmr_uring_receive(worker, flags >> IORING_CQE_BUFFER_SHIFT);
+                    received++;
+                }
+                break;
+
+            case DMR_EVENT_TIMER:
+                rearm_timer |= !(flags & IORING_CQE_F_MORE);
+                if (read(worker->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                    tick = true;
+                }
+                break;
+
+            case DMR_EVENT_SEND:
+                dmr_uring_send_done(worker, (unsigned)(user_data >> DMR_EVENT_BITS), result);
+                break;
+            }
+        }
+        worker->tx_deferred = false;
+
+        if (received > 0) {
+            dmr_record_batch(worker, received);
+        }
+
+        /* The kernel ends a multishot request on errors and completion queue overflows */
+        if ((rearm_recv &&
+             dmr_uring_recv_multishot(&io->ring, worker->socket, &io->rx_msg, DMR_EVENT_SOCKET) != 0) ||
+            (rearm_timer &&
+             dmr_uring_poll_multishot(&io->ring, worker->timer_fd, DMR_EVENT_TIMER) != 0)) {
+            perror("Failed to rearm worker events");
+            return;
+        }
+
+        if (tick) {
+            dmr_clock_update();
+            expire_more = dmr_housekeeping();
+        }
+    }
+}
+#endif
+
+/* Run the DMR server on worker 0 */
+int dmr_server_run(void) {
+    return dmr_server_run_worker(0);
+}
+
+/* Run one receive worker until dmr_server_stop(); worker 0 also does the periodic housekeeping */
+int dmr_server_run_worker(int worker_id) {
+    dmr_worker_t *worker;
+    
+    if (worker_id < 0 || worker_id >= worker_count) {
+        fprintf(stderr, "Invalid worker id: %d\n", worker_id);
+        return -1;
+    }
+    worker = &workers[worker_id];
+    current_worker = worker;
+    
+    printf("DMR Voice Relay Server worker %d running...\n", worker_id);
+    dmr_clock_update();
+    
+#ifdef DMR_HAVE_URING
+    if (worker->uring != NULL) {
+        dmr_uring_loop(worker);
+        return 0;
+    }
+#endif
+#ifdef DMR_HAVE_EPOLL
+    dmr_worker_loop(worker);
+#else
+    /* Receives time out every second, so the stop flag and housekeeping are never far off */
+    while (!__atomic_load_n(&server_stopping, __ATOMIC_RELAXED)) {
+        dmr_receive(worker);
+        if (worker_id == 0) {
+            dmr_housekeeping();
+        }
+    }
+#endif
+    
+    return 0;
+}
+
+/* Make every worker return from dmr_server_run_worker(); safe to call from a signal handler */
+void dmr_server_stop(void) {
+#ifdef DMR_HAVE_EPOLL
+    uint64_t one = 1;
+#endif
+    
+    __atomic_store_n(&server_stopping, 1, __ATOMIC_RELAXED);
+#ifdef DMR_HAVE_EPOLL
+    /* Never read, so it stays readable for every worker */
+    if (stop_fd >= 0) {
+        ssize_t written = write(stop_fd, &one, sizeof(one));
+        (void)written;
+    }
+#endif
+}
+
+/* Fill a client's callsign from the cache; returns true if the database
+ * should be asked instead. Caller holds the client write lock. */
+static bool dmr_resolve_callsign(dmr_client_t *client, uint64_t now) {
+    if (!server_config.db.enabled || client->dmr_id == 0) {
+        return false;
+    }
+    
+    return dmr_callsign_lookup(client->dmr_id, client->callsign, sizeof(client->callsign), now) ==
+           DMR_CALLSIGN_MISS;
+}
+
+/* Count a call that ended without a terminator and print it if verbose */
+static void dmr_report_lost_call(const struct sockaddr_in *addr, const dmr_call_t *call, uint64_t now) {
+    dmr_worker_t *worker = current_worker ? current_worker : &workers[0];
+    
+    DMR_STATS_ADD(worker->stats, calls_lost, 1);
+    
+    if (server_config.verbose) {
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr->sin_addr, client_ip, INET_ADDRSTRLEN);
+        
+        printf("Call lost on %s:%d, Slot: %d, Src ID: %u, Dst ID: %u, no terminator, "
+               "started %llu ms ago, silent for %llu ms\n",
+               client_ip, ntohs(addr->sin_port), call->slot, call->src_id, call->dst_id,
+               (unsigned long long)(now > call->started ? now - call->started : 0),
+               (unsigned long long)(now > call->last_frame ? now - call->last_frame : 0));
+    }
+}
+
+/* Schedule a call's expiry timer for its next state change, if it has one.
+ * Caller holds the client write lock. */
+static void dmr_call_arm(dmr_call_t *call) {
+    uint64_t deadline = dmr_call_deadline(call, (uint32_t)server_config.call_timeout_ms,
+                                          (uint32_t)server_config.call_hang_ms);
+    
+    if (deadline != 0) {
+        dmr_wheel_schedule(&call_wheel, &call->timer, deadline / DMR_TIMER_TICK_MS + 1);
+    } else {
+        dmr_wheel_cancel(&call_wheel, &call->timer);
+    }
+}
+
+/* Classify a frame by the sender's call on its slot, keeping a copy of the
+ * call before and after; arm is set if the call needs its expiry timer
+ * scheduled. Caller holds the client lock, shared or exclusive. */
+static int dmr_track_call(dmr_client_t *client, const dmr_frame_view_t *frame, uint64_t now,
+                          dmr_call_t *before, dmr_call_t *after, bool *lost, bool *arm) {
+    dmr_call_t *call = &client->calls[dmr_frame_slot(frame) - DMR_SLOT_1];
+    int call_class;
+    
+    /* Held for a few instructions; workers only meet here when steering splits a repeater */
+    while (__atomic_test_and_set(&client->call_lock, __ATOMIC_ACQUIRE)) {
+    }
+    call->slot = dmr_frame_slot(frame);
+    *before = *call;
+    call_class = dmr_call_classify(call, dmr_frame_type(frame), dmr_frame_src_id(frame),
+                                   dmr_frame_dst_id(frame), now, (uint32_t)server_config.call_timeout_ms,
+                                   (uint32_t)server_config.call_hang_ms, lost);
+    *after = *call;
+    
+    /* Timers only move under the write lock, and once pending a timer moves itself on */
+    *arm = call->state != DMR_CALL_IDLE && call->timer.next == NULL;
+    __atomic_clear(&client->call_lock, __ATOMIC_RELEASE);
+    
+    return call_class;
+}
+
+/* Process a DMR frame; returns its DMR_CALL_* classification */
+int dmr_process_frame(const dmr_frame_view_t *frame, struct sockaddr_in *client_addr) {
+    dmr_worker_t *worker = current_worker ? current_worker : &workers[0];
+    dmr_client_t *client;
+    uint8_t slot = dmr_frame_slot(frame);
+    uint32_t src_id = dmr_frame_src_id(frame);
+    uint32_t dst_id = dmr_frame_dst_id(frame);
+    bool client_found;
+    bool learn_id = false;
+    bool group_call = false;
+    bool subscribe = false;
+    bool lookup_callsign = false;
+    bool has_call = slot == DMR_SLOT_1 || slot == DMR_SLOT_2;
+    bool call_lost = false;
+    bool arm_call = false;
+    int call_class = DMR_CALL_NONE;
+    dmr_call_t call_before, call_after;
+    uint64_t now = dmr_clock_now();
+    uint64_t sub_expires = now + (uint64_t)server_config.dynamic_tg_timeout * 1000;
+    
+    /* Check if client exists */
+    dmr_rwlock_rdlock(&clients_lock);
+    client = dmr_clients_lookup(client_addr);
+    client_found = client != NULL;
+    
+    /* A group call is one whose destination is not a connected client's ID */
+    if (server_config.routing == DMR_ROUTING_TALKGROUP && dst_id != 0 &&
+        (slot == DMR_SLOT_1 || slot == DMR_SLOT_2)) {
+        group_call = dmr_clients_lookup_id(dst_id) == NULL;
+    }
+    
+    if (client_found) {
+        /* Update last seen time */
+        __atomic_store_n(&client->last_seen, now, __ATOMIC_RELAXED);
+        
+        /* Update DMR ID if needed */
+        learn_id = client->dmr_id == 0 && src_id != 0;
+        
+        /* Keep the sender subscribed to the talkgroup it transmits on */
+        if (group_call) {
+            subscribe = !dmr_route_refresh(client, dst_id, slot, sub_expires);
+        }
+        
+        if (has_call) {
+            call_class = dmr_track_call(client, frame, now, &call_before, &call_after, &call_lost, &arm_call);
+        }
+    }
+    dmr_rwlock_rdunlock(&clients_lock);
+    
+    /* Add new client if not found; a full registry still relays the frame */
+    if (!client_found) {
+        if (dmr_add_client(client_addr, src_id, NULL) != 0) {
+            DMR_STATS_ADD(worker->stats, errors[DMR_ERR_CLIENT_LIMIT], 1);
+        }
+        subscribe = group_call;
+    }
+    
+    if (learn_id || subscribe || arm_call || (!client_found && has_call)) {
+        dmr_rwlock_wrlock(&clients_lock);
+        client = dmr_clients_lookup(client_addr);
+        if (client != NULL && !client_found && has_call) {
+            call_class = dmr_track_call(client, frame, now, &call_before, &call_after, &call_lost, &arm_call);
+        }
+        if (client != NULL && has_call && client->calls[slot - DMR_SLOT_1].timer.next == NULL) {
+            dmr_call_arm(&client->calls[slot - DMR_SLOT_1]);
+        }
+        if (client != NULL && learn_id && client->dmr_id == 0) {
+            dmr_clients_set_id(client, src_id);
+            dmr_route_client_identified(client);
+            lookup_callsign = dmr_resolve_callsign(client, now);
+        }
+        if (client != NULL && subscribe) {
+            dmr_route_subscribe(client, dst_id, slot, false, sub_expires);
+        }
+        dmr_rwlock_wrunlock(&clients_lock);
+    }
+    
+    /* Not cached, look the callsign up on the database writer thread */
+    if (lookup_callsign) {
+        dmr_db_queue_callsign(src_id, client_addr);
     }
-#endif
-
-    /* Copy configuration */
-    memcpy(&server_config, config, sizeof(dmr_config_t));
     
-    /* Initialize client array */
-    for (i = 0; i < DMR_MAX_CLIENTS; i++) {
-        clients[i].active = false;
+    /* The frame beat the call's timer to the timeout */
+    DMR_STATS_ADD(worker->stats, call_frames[call_class], 1);
+    if (call_lost) {
+        dmr_report_lost_call(client_addr, &call_before, now);
     }
     
-    /* Initialize database if enabled */
-    if (config->db.enabled) {
-        if (dmr_db_init(&config->db) != 0) {
-            fprintf(stderr, "Warning: Failed to initialize database connection\n");
-            /* Continue without database */
+    /* Print frame info if verbose */
+    if (server_config.verbose) {
+        char src_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &client_addr->sin_addr, src_ip, INET_ADDRSTRLEN);
+        
+        if (call_class == DMR_CALL_START) {
+            printf("Call started on %s:%d, Slot: %d, Src ID: %u, Dst ID: %u\n",
+                   src_ip, ntohs(client_addr->sin_port), slot, src_id, dst_id);
+        } else if (call_class == DMR_CALL_END) {
+            printf("Call ended on %s:%d, Slot: %d, Src ID: %u, Dst ID: %u, %llu ms\n",
+                   src_ip, ntohs(client_addr->sin_port), slot, src_id, dst_id,
+                   (unsigned long long)(call_after.last_frame - call_after.started));
         }
+        printf("Received %s frame from %s:%d, Src ID: %u, Dst ID: %u, Slot: %d\n",
+               dmr_frame_type(frame) == DMR_PKT_VOICE ? "Voice" :
+               dmr_frame_type(frame) == DMR_PKT_DATA ? "Data" :
+               dmr_frame_type(frame) == DMR_PKT_CONTROL ? "Control" :
+               dmr_frame_type(frame) == DMR_PKT_SYNC ? "Sync" : "Unknown",
+               src_ip, ntohs(client_addr->sin_port),
+               src_id, dst_id, slot);
     }
     
-    /* Create UDP socket */
-    server_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (server_socket < 0) {
-#ifdef _WIN32
-        fprintf(stderr, "Failed to create socket: %d\n", WSAGetLastError());
-        WSACleanup();
-#else
-        perror("Failed to create socket");
-#endif
-        return -1;
+    /* Log frame to database if enabled */
+    if (server_config.db.enabled) {
+        dmr_db_queue_frame(frame, client_addr);
     }
     
-    /* Set up server address */
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(config->port);
+    return call_class;
+}
+
+#ifdef DMR_HAVE_MMSG
+/* Send every queued fan-out message, resuming after partial sends */
+static void dmr_tx_send_queued(dmr_worker_t *worker) {
+    int offset = 0;
+    int i;
     
-    if (config->bind_addr) {
-        if (inet_pton(AF_INET, config->bind_addr, &server_addr.sin_addr) <= 0) {
-            fprintf(stderr, "Invalid bind address: %s\n", config->bind_addr);
-#ifdef _WIN32
-            closesocket(server_socket);
-            WSACleanup();
-#else
-            close(server_socket);
-#endif
-            return -1;
+    while (offset < worker->tx_count) {
+        int sent = sendmmsg(worker->socket, worker->tx_msgs + offset, worker->tx_count - offset, 0);
+        uint64_t now = dmr_stats_clock();
+        
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /* The message at offset failed, skip it and carry on */
+            perror("Failed to send to client");
+            DMR_STATS_ADD(worker->stats, errors[DMR_ERR_SEND], 1);
+            offset++;
+            continue;
         }
-    } else {
-        server_addr.sin_addr.s_addr = INADDR_ANY;
+        
+        for (i = offset; i < offset + sent; i++) {
+            DMR_STATS_ADD(worker->stats, bytes_sent, worker->tx_msgs[i].msg_len);
+            if (worker->tx_marks[i] & DMR_TX_FIRST) {
+                dmr_latency_record(&worker->latency[DMR_LAT_FIRST_SEND], now - worker->tx_started[i]);
+            }
+            if (worker->tx_marks[i] & DMR_TX_LAST) {
+                dmr_latency_record(&worker->latency[DMR_LAT_LAST_SEND], now - worker->tx_started[i]);
+            }
+        }
+        DMR_STATS_ADD(worker->stats, packets_relayed, sent);
+        offset += sent;
     }
     
-    /* Bind socket */
-    if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+    worker->tx_count = 0;
+}
+
+/* Flush the calling worker's queued fan-out */
+void dmr_relay_flush(void) {
+    dmr_worker_t *worker = current_worker ? current_worker : &workers[0];
+    
+#ifdef DMR_HAVE_URING
+    /* Completions are accounted for by the worker's event loop */
+    if (worker->uring != NULL) {
+        dmr_uring_submit(&worker->uring->ring, 0);
+        return;
+    }
+#endif
+    if (worker->tx_count > 0) {
+        dmr_tx_send_queued(worker);
+    }
+}
+#else
+/* Sends are made inline, nothing is queued */
+void dmr_relay_flush(void) {
+}
+#endif
+
+/* Check whether two addresses are the same endpoint */
+static bool dmr_same_addr(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return b != NULL && a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+#if !defined(DMR_HAVE_MMSG) || defined(DMR_HAVE_URING)
+/* Send one relayed frame to one destination right away */
+static void dmr_relay_now(dmr_worker_t *worker, const uint8_t *buffer, int buffer_size,
+                          const struct sockaddr_in *addr, bool first) {
+    int sent = sendto(worker->socket, (const char *)buffer, buffer_size, 0,
+                     (const struct sockaddr *)addr, sizeof(*addr));
+    
+    if (sent < 0) {
 #ifdef _WIN32
-        fprintf(stderr, "Failed to bind socket: %d\n", WSAGetLastError());
-        closesocket(server_socket);
-        WSACleanup();
+        fprintf(stderr, "Failed to send to client: %d\n", WSAGetLastError());
 #else
-        perror("Failed to bind socket");
-        close(server_socket);
+        perror("Failed to send to client");
 #endif
-        return -1;
+        DMR_STATS_ADD(worker->stats, errors[DMR_ERR_SEND], 1);
+    } else {
+        DMR_STATS_ADD(worker->stats, bytes_sent, sent);
+        DMR_STATS_ADD(worker->stats, packets_relayed, 1);
+        if (first) {
+            dmr_latency_record(&worker->latency[DMR_LAT_FIRST_SEND], dmr_stats_clock() - worker->frame_nsec);
+        }
     }
-    
-    printf("DMR Voice Relay Server initialized on port %d\n", config->port);
-    return 0;
 }
+#endif
 
-/* Run the DMR server */
-int dmr_server_run(void) {
-    struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
-    uint8_t buffer[DMR_BUFFER_SIZE];
-    int bytes_read;
-    dmr_frame_t frame;
+#ifdef DMR_HAVE_URING
+/* Queue a sendmsg of the frame being relayed, copied into the pool on its
+ * first send; returns false if no send slot, frame buffer or submission
+ * entry is free */
+static bool dmr_uring_relay_to(dmr_worker_t *worker, const uint8_t *buffer, int buffer_size,
+                               const struct sockaddr_in *addr, bool first) {
+    dmr_uring_io_t *io = worker->uring;
+    dmr_uring_send_t *send;
+    dmr_frame_view_t frame;
+    unsigned slot;
     
-    printf("DMR Voice Relay Server running...\n");
+    if (io->free_count == 0) {
+        return false;
+    }
+    if (io->frame == NULL) {
+        frame.data = buffer;
+        frame.length = buffer_size;
+        io->frame = dmr_pool_get(&io->pool, &frame, io->frame_source);
+        if (io->frame == NULL) {
+            return false;
+        }
+    }
+    slot = io->free_sends[io->free_count - 1];
+    send = &io->sends[slot];
+    send->addr = *addr;
+    send->iov.iov_base = io->frame->data;
+    send->iov.iov_len = io->frame->length;
+    if (dmr_uring_sendmsg(&io->ring, worker->socket, &send->msg,
+                          ((uint64_t)slot << DMR_EVENT_BITS) | DMR_EVENT_SEND) != 0) {
+        return false;
+    }
     
-    while (1) {
-        /* Receive data */
-        bytes_read = recvfrom(server_socket, (char *)buffer, DMR_BUFFER_SIZE, 0, 
-                             (struct sockaddr *)&client_addr, &addr_len);
-        
-        if (bytes_read < 0) {
-#ifdef _WIN32
-            int err = WSAGetLastError();
-            if (err == WSAEWOULDBLOCK || err == WSAEINTR) {
-                continue;
-            }
-            fprintf(stderr, "Error receiving data: %d\n", err);
+    io->free_count--;
+    send->started = worker->frame_nsec;
+    send->marks = first ? DMR_TX_FIRST : 0;
+    send->frame = io->frame;
+    dmr_pool_hold(send->frame);
+    io->last_send = (int)slot;
+    return true;
+}
+#endif
+
+/* Send or queue one relayed frame to one destination; first marks the
+ * frame's first recipient */
+static void dmr_relay_to(dmr_worker_t *worker, const uint8_t *buffer, int buffer_size,
+                         const struct sockaddr_in *addr, bool first) {
+#ifdef DMR_HAVE_URING
+    /* Every send slot or frame buffer busy, send this one inline */
+    if (worker->uring != NULL) {
+        if (!dmr_uring_relay_to(worker, buffer, buffer_size, addr, first)) {
+            worker->uring->last_send = -1;
+            dmr_relay_now(worker, buffer, buffer_size, addr, first);
+        }
+        return;
+    }
+#endif
+#ifdef DMR_HAVE_MMSG
+    /* Queue frame, sending early if the vector is full */
+    if (worker->tx_count == DMR_TX_QUEUE_SIZE) {
+        dmr_tx_send_queued(worker);
+    }
+    worker->tx_addrs[worker->tx_count] = *addr;
+    worker->tx_iovecs[worker->tx_count].iov_base = (void *)buffer;
+    worker->tx_iovecs[worker->tx_count].iov_len = buffer_size;
+    worker->tx_started[worker->tx_count] = worker->frame_nsec;
+    worker->tx_marks[worker->tx_count] = first ? DMR_TX_FIRST : 0;
+    worker->tx_count++;
 #else
-            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-                continue;
-            }
-            perror("Error receiving data");
+    dmr_relay_now(worker, buffer, buffer_size, addr, first);
 #endif
-            continue;
+}
+
+/* Mark the frame's last recipient for latency measurement */
+static void dmr_relay_mark_last(dmr_worker_t *worker) {
+#ifdef DMR_HAVE_URING
+    if (worker->uring != NULL) {
+        if (worker->uring->last_send >= 0) {
+            worker->uring->sends[worker->uring->last_send].marks |= DMR_TX_LAST;
+        } else {
+            dmr_latency_record(&worker->latency[DMR_LAT_LAST_SEND], dmr_stats_clock() - worker->frame_nsec);
         }
-        
-        /* Update statistics */
-        packets_received++;
-        bytes_received += bytes_read;
-        
-        /* Process received data */
-        if (bytes_read >= DMR_HEADER_SIZE) {
-            /* Parse DMR frame */
-            frame.type = buffer[0];
-            frame.slot = buffer[1];
-            frame.src_id = (buffer[2] << 16) | (buffer[3] << 8) | buffer[4];
-            frame.dst_id = (buffer[5] << 16) | (buffer[6] << 8) | buffer[7];
-            
-            /* Copy payload */
-            int payload_size = bytes_read - DMR_HEADER_SIZE;
-            if (payload_size > DMR_PAYLOAD_SIZE) {
-                payload_size = DMR_PAYLOAD_SIZE;
+        return;
+    }
+#endif
+#ifdef DMR_HAVE_MMSG
+    /* Still queued, even if the queue was flushed part way through the fan-out */
+    worker->tx_marks[worker->tx_count - 1] |= DMR_TX_LAST;
+#else
+    dmr_latency_record(&worker->latency[DMR_LAT_LAST_SEND], dmr_stats_clock() - worker->frame_nsec);
+#endif
+}
+
+/* Relay a DMR frame to the interested clients except the sender. The
+ * received bytes are sent as they are, so they must stay untouched until
+ * the fan-out is flushed. */
+int dmr_relay_frame(const dmr_frame_view_t *frame, struct sockaddr_in *exclude_addr) {
+    dmr_worker_t *worker = current_worker ? current_worker : &workers[0];
+    const struct sockaddr_in *peers;
+    const dmr_route_member_t *members;
+    dmr_client_t *target;
+    uint32_t dst_id = dmr_frame_dst_id(frame);
+    const uint8_t *buffer = frame->data;
+    int buffer_size = frame->length;
+    int recipients = 0;
+    int count;
+    int i;
+    
+    dmr_rwlock_rdlock(&clients_lock);
+    if (server_config.routing == DMR_ROUTING_BROADCAST) {
+        /* Send to all active clients except the sender */
+        peers = dmr_clients_peers(&count);
+        for (i = 0; i < count; i++) {
+            if (!dmr_same_addr(&peers[i], exclude_addr)) {
+                dmr_relay_to(worker, buffer, buffer_size, &peers[i], recipients++ == 0);
             }
-            memcpy(frame.payload, buffer + DMR_HEADER_SIZE, payload_size);
-            
-            /* Process frame */
-            dmr_process_frame(&frame, &client_addr);
-            
-            /* Relay frame to other clients */
-            dmr_relay_frame(&frame, &client_addr);
         }
-        
-        /* Periodically clean up inactive clients */
-        static time_t last_cleanup = 0;
-        time_t now = time(NULL);
-        if (now - last_cleanup > 60) { /* Clean up every minute */
-            dmr_cleanup_clients();
-            last_cleanup = now;
-            
-            /* Print statistics */
-            if (server_config.verbose) {
-                dmr_print_stats();
+    } else if ((target = dmr_clients_lookup_id(dst_id)) != NULL) {
+        /* Private call, send to the client owning the destination ID */
+        if (!dmr_same_addr(&target->addr, exclude_addr)) {
+            dmr_relay_to(worker, buffer, buffer_size, &target->addr, recipients++ == 0);
+        }
+    } else {
+        /* Group call, send to the talkgroup's subscribers on this slot */
+        members = dmr_route_members(dst_id, dmr_frame_slot(frame), &count);
+        for (i = 0; i < count; i++) {
+            if (!dmr_same_addr(&members[i].addr, exclude_addr)) {
+                dmr_relay_to(worker, buffer, buffer_size, &members[i].addr, recipients++ == 0);
             }
         }
     }
+    dmr_rwlock_rdunlock(&clients_lock);
+    
+    if (recipients == 0) {
+        DMR_STATS_ADD(worker->stats, errors[DMR_ERR_NO_ROUTE], 1);
+    } else {
+        dmr_relay_mark_last(worker);
+    }
+    
+    /* Outside a receive batch, send this frame's fan-out now */
+#ifdef DMR_HAVE_MMSG
+    if (!worker->tx_deferred) {
+        dmr_relay_flush();
+    }
+#endif
     
     return 0;
 }
 
-/* Process a DMR frame */
-int dmr_process_frame(dmr_frame_t *frame, struct sockaddr_in *client_addr) {
-    int i;
-    bool client_found = false;
+/* Add a new client */
+int dmr_add_client(struct sockaddr_in *addr, uint32_t dmr_id, const char *callsign) {
+    dmr_client_t *client;
+    dmr_client_t added;
+    bool lookup_callsign = false;
+    int total;
     
-    /* Check if client exists */
-    for (i = 0; i < DMR_MAX_CLIENTS; i++) {
-        if (clients[i].active && 
-            clients[i].addr.sin_addr.s_addr == client_addr->sin_addr.s_addr && 
-            clients[i].addr.sin_port == client_addr->sin_port) {
-            
-            /* Update last seen time */
-            clients[i].last_seen = time(NULL);
-            
-            /* Update DMR ID if needed */
-            if (clients[i].dmr_id == 0 && frame->src_id != 0) {
-                clients[i].dmr_id = frame->src_id;
-                
-                /* Try to get callsign from database */
-                if (server_config.db.enabled) {
-                    char callsign[10];
-                    if (dmr_db_get_callsign(frame->src_id, callsign, sizeof(callsign)) == 0) {
-                        strncpy(clients[i].callsign, callsign, sizeof(clients[i].callsign) - 1);
-                        clients[i].callsign[sizeof(clients[i].callsign) - 1] = '\0';
-                    }
-                }
-            }
-            
-            client_found = true;
-            break;
-        }
+    dmr_rwlock_wrlock(&clients_lock);
+    
+    /* Another worker may have added it since the caller looked */
+    if (dmr_clients_lookup(addr) != NULL) {
+        dmr_rwlock_wrunlock(&clients_lock);
+        return 0;
     }
     
-    /* Add new client if not found */
-    if (!client_found) {
-        dmr_add_client(client_addr, frame->src_id, NULL);
+    /* Register client, growing the table if needed */
+    client = dmr_clients_insert(addr);
+    if (client == NULL) {
+        dmr_rwlock_wrunlock(&clients_lock);
+        fprintf(stderr, "Maximum number of clients reached\n");
+        return -1;
     }
     
-    /* Print frame info if verbose */
+    client->last_seen = dmr_clock_now();
+    dmr_wheel_schedule(&timeout_wheel, &client->timeout, dmr_timeout_tick(client->last_seen));
+    dmr_clients_set_id(client, dmr_id);
+    if (dmr_id != 0) {
+        dmr_route_client_identified(client);
+    }
+    
+    if (callsign) {
+        strncpy(client->callsign, callsign, sizeof(client->callsign) - 1);
+        client->callsign[sizeof(client->callsign) - 1] = '\0';
+    } else {
+        client->callsign[0] = '\0';
+        lookup_callsign = dmr_resolve_callsign(client, client->last_seen);
+    }
+    
+    total = dmr_clients_count();
+    __atomic_store_n(&clients_published, total, __ATOMIC_RELAXED);
+    added = *client;
+    dmr_rwlock_wrunlock(&clients_lock);
+    
+    /* Print client info if verbose */
     if (server_config.verbose) {
-        char src_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &client_addr->sin_addr, src_ip, INET_ADDRSTRLEN);
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr->sin_addr, client_ip, INET_ADDRSTRLEN);
         
-        printf("Received %s frame from %s:%d, Src ID: %u, Dst ID: %u, Slot: %d\n",
-               frame->type == DMR_PKT_VOICE ? "Voice" :
-               frame->type == DMR_PKT_DATA ? "Data" :
-               frame->type == DMR_PKT_CONTROL ? "Control" :
-               frame->type == DMR_PKT_SYNC ? "Sync" : "Unknown",
-               src_ip, ntohs(client_addr->sin_port),
-               frame->src_id, frame->dst_id, frame->slot);
+        printf("New client connected: %s:%d, DMR ID: %u, Total clients: %d\n",
+               client_ip, ntohs(addr->sin_port), dmr_id, total);
     }
     
-    /* Log frame to database if enabled */
+    /* Log client connection to database if enabled */
     if (server_config.db.enabled) {
-        dmr_db_log_frame(frame, client_addr);
+        dmr_db_queue_client(&added, "connect");
+        if (lookup_callsign) {
+            dmr_db_queue_callsign(dmr_id, addr);
+        }
     }
     
     return 0;
 }
 
-/* Relay a DMR frame to all clients except the sender */
-int dmr_relay_frame(dmr_frame_t *frame, struct sockaddr_in *exclude_addr) {
+/* Cancel a client's call timers before it is erased. Caller holds the client write lock. */
+static void dmr_cancel_calls(dmr_client_t *client) {
     int i;
-    uint8_t buffer[DMR_BUFFER_SIZE];
-    int buffer_size = 0;
-    
-    /* Build frame buffer */
-    buffer[0] = frame->type;
-    buffer[1] = frame->slot;
-    buffer[2] = (frame->src_id >> 16) & 0xFF;
-    buffer[3] = (frame->src_id >> 8) & 0xFF;
-    buffer[4] = frame->src_id & 0xFF;
-    buffer[5] = (frame->dst_id >> 16) & 0xFF;
-    buffer[6] = (frame->dst_id >> 8) & 0xFF;
-    buffer[7] = frame->dst_id & 0xFF;
-    
-    /* Copy payload */
-    memcpy(buffer + DMR_HEADER_SIZE, frame->payload, DMR_PAYLOAD_SIZE);
-    buffer_size = DMR_HEADER_SIZE + DMR_PAYLOAD_SIZE;
-    
-    /* Send to all active clients except the sender */
-    for (i = 0; i < DMR_MAX_CLIENTS; i++) {
-        if (clients[i].active) {
-            /* Skip sender */
-            if (exclude_addr && 
-                clients[i].addr.sin_addr.s_addr == exclude_addr->sin_addr.s_addr && 
-                clients[i].addr.sin_port == exclude_addr->sin_port) {
-                continue;
-            }
-            
-            /* Send frame */
-            int sent = sendto(server_socket, (char *)buffer, buffer_size, 0,
-                             (struct sockaddr *)&clients[i].addr, sizeof(clients[i].addr));
-            
-            if (sent < 0) {
-#ifdef _WIN32
-                fprintf(stderr, "Failed to send to client: %d\n", WSAGetLastError());
-#else
-                perror("Failed to send to client");
-#endif
-            } else {
-                bytes_sent += sent;
-                packets_relayed++;
-            }
+    
+    for (i = 0; i < 2; i++) {
+        dmr_wheel_cancel(&call_wheel, &client->calls[i].timer);
+    }
+}
+
+/* Count the calls a removed client was in the middle of as lost */
+static void dmr_report_removed_calls(const dmr_client_t *removed, uint64_t now) {
+    int i;
+    
+    for (i = 0; i < 2; i++) {
+        if (removed->calls[i].state == DMR_CALL_ACTIVE) {
+            dmr_report_lost_call(&removed->addr, &removed->calls[i], now);
         }
     }
+}
+
+/* Remove a client */
+int dmr_remove_client(struct sockaddr_in *addr) {
+    dmr_client_t *client;
+    dmr_client_t removed;
+    
+    dmr_rwlock_wrlock(&clients_lock);
+    client = dmr_clients_lookup(addr);
+    if (client == NULL) {
+        dmr_rwlock_wrunlock(&clients_lock);
+        return -1;
+    }
+    
+    /* Remove client */
+    removed = *client;
+    dmr_route_client_removed(client);
+    dmr_wheel_cancel(&timeout_wheel, &client->timeout);
+    dmr_cancel_calls(client);
+    dmr_clients_erase(client);
+    __atomic_store_n(&clients_published, dmr_clients_count(), __ATOMIC_RELAXED);
+    dmr_rwlock_wrunlock(&clients_lock);
+    
+    dmr_report_removed_calls(&removed, dmr_clock_now());
+    
+    /* Print client info if verbose */
+    if (server_config.verbose) {
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr->sin_addr, client_ip, INET_ADDRSTRLEN);
+        
+        printf("Client disconnected: %s:%d, DMR ID: %u\n",
+               client_ip, ntohs(addr->sin_port), removed.dmr_id);
+    }
+    
+    /* Log client disconnection to database if enabled */
+    if (server_config.db.enabled) {
+        dmr_db_queue_client(&removed, "disconnect");
+    }
+    
+    /* Log client timeout to database if enabled */
+    if (server_config.db.enabled) {
+        dmr_db_queue_client(&removed, "timeout");
+    }
     
     return 0;
 }
 
-/* Add a new client */
-int dmr_add_client(struct sockaddr_in *addr, uint32_t dmr_id, const char *callsign) {
+/* Apply a callsign found by the database writer */
+void dmr_update_callsign(struct sockaddr_in *addr, uint32_t dmr_id, const char *callsign) {
+    dmr_client_t *client;
+    
+    dmr_rwlock_wrlock(&clients_lock);
+    client = dmr_clients_lookup(addr);
+    if (client != NULL && client->dmr_id == dmr_id) {
+        strncpy(client->callsign, callsign, sizeof(client->callsign) - 1);
+        client->callsign[sizeof(client->callsign) - 1] = '\0';
+    }
+    dmr_rwlock_wrunlock(&clients_lock);
+}
+
+/* Expire clients whose inactivity timer is due by the calling worker's clock,
+ * at most DMR_EXPIRE_SLICE per call; returns the number of timers handled */
+int dmr_cleanup_clients(void) {
+    dmr_timer_t *due[DMR_EXPIRE_SLICE];
+    dmr_client_t expired[DMR_EXPIRE_SLICE];
+    int count;
+    int expired_count = 0;
     int i;
+    uint64_t now = dmr_clock_now();
     
-    /* Find an empty slot */
-    for (i = 0; i < DMR_MAX_CLIENTS; i++) {
-        if (!clients[i].active) {
-            /* Add client */
-            memcpy(&clients[i].addr, addr, sizeof(struct sockaddr_in));
-            clients[i].last_seen = time(NULL);
-            clients[i].dmr_id = dmr_id;
-            clients[i].active = true;
-            
-            if (callsign) {
-                strncpy(clients[i].callsign, callsign, sizeof(clients[i].callsign) - 1);
-                clients[i].callsign[sizeof(clients[i].callsign) - 1] = '\0';
-            } else {
-                clients[i].callsign[0] = '\0';
-            }
-            
-            client_count++;
-            
-            /* Print client info if verbose */
-            if (server_config.verbose) {
-                char client_ip[INET_ADDRSTRLEN];
-                inet_ntop(AF_INET, &addr->sin_addr, client_ip, INET_ADDRSTRLEN);
-                
-                printf("New client connected: %s:%d, DMR ID: %u, Total clients: %d\n",
-                       client_ip, ntohs(addr->sin_port), dmr_id, client_count);
-            }
-            
-            /* Log client connection to database if enabled */
-            if (server_config.db.enabled) {
-                dmr_db_log_client(&clients[i], "connect");
-            }
+    dmr_rwlock_wrlock(&clients_lock);
+    count = dmr_wheel_advance(&timeout_wheel, now / DMR_TIMER_TICK_MS, due, DMR_EXPIRE_SLICE);
+    for (i = 0; i < count; i++) {
+        dmr_client_t *client = (dmr_client_t *)((char *)due[i] - offsetof(dmr_client_t, timeout));
+        
+        /* Activity only moves last_seen, so a client heard from since is rescheduled here.
+         * Other workers' clocks may run slightly ahead of this one. */
+        if (now > client->last_seen && now - client->last_seen > (uint64_t)server_config.timeout * 1000) {
+            expired[expired_count++] = *client;
+            dmr_route_client_removed(client);
+            dmr_cancel_calls(client);
+            dmr_clients_erase(client);
+        } else {
+            dmr_wheel_schedule(&timeout_wheel, &client->timeout, dmr_timeout_tick(client->last_seen));
+        }
+    }
+    __atomic_store_n(&clients_published, dmr_clients_count(), __ATOMIC_RELAXED);
+    dmr_rwlock_wrunlock(&clients_lock);
+    
+    /* Log outside the lock */
+    for (i = 0; i < expired_count; i++) {
+        dmr_report_removed_calls(&expired[i], now);
+        
+        /* Print client info if verbose */
+        if (server_config.verbose) {
+            char client_ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &expired[i].addr.sin_addr, client_ip, INET_ADDRSTRLEN);
             
-            return 0;
+            printf("Client timed out: %s:%d, DMR ID: %u\n",
+                   client_ip, ntohs(expired[i].addr.sin_port), expired[i].dmr_id);
+        }
+        
+        /* Log client timeout to database if enabled */
+        if (server_config.db.enabled) {
+            dmr_db_queue_client(&expired[i], "timeout");
         }
     }
     
-    fprintf(stderr, "Maximum number of clients reached\n");
-    return -1;
+    return count;
 }
 
-/* Remove a client */
-int dmr_remove_client(struct sockaddr_in *addr) {
+/* Apply call timeouts and hang expiry due by the calling worker's clock, at
+ * most DMR_EXPIRE_SLICE per call; returns the number of timers handled */
+int dmr_expire_calls(void) {
+    dmr_timer_t *due[DMR_EXPIRE_SLICE];
+    dmr_call_t lost[DMR_EXPIRE_SLICE];
+    struct sockaddr_in lost_addrs[DMR_EXPIRE_SLICE];
+    int count;
+    int lost_count = 0;
     int i;
+    uint64_t now = dmr_clock_now();
     
-    for (i = 0; i < DMR_MAX_CLIENTS; i++) {
-        if (clients[i].active && 
-            clients[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr && 
-            clients[i].addr.sin_port == addr->sin_port) {
-            
-            /* Print client info if verbose */
-            if (server_config.verbose) {
-                char client_ip[INET_ADDRSTRLEN];
-                inet_ntop(AF_INET, &addr->sin_addr, client_ip, INET_ADDRSTRLEN);
-                
-                printf("Client disconnected: %s:%d, DMR ID: %u\n",
-                       client_ip, ntohs(addr->sin_port), clients[i].dmr_id);
-            }
-            
-            /* Log client disconnection to database if enabled */
-            if (server_config.db.enabled) {
-                dmr_db_log_client(&clients[i], "disconnect");
-            }
-            
-            /* Log client timeout to database if enabled */
-            if (server_config.db.enabled) {
-                dmr_db_log_client(&clients[i], "timeout");
-            }
-            
-            /* Remove client */
-            clients[i].active = false;
-            client_count--;
-            
-            return 0;
+    dmr_rwlock_wrlock(&clients_lock);
+    count = dmr_wheel_advance(&call_wheel, now / DMR_TIMER_TICK_MS, due, DMR_EXPIRE_SLICE);
+    for (i = 0; i < count; i++) {
+        dmr_call_t *call = (dmr_call_t *)((char *)due[i] - offsetof(dmr_call_t, timer));
+        dmr_client_t *client = (dmr_client_t *)((char *)(call - (call->slot - DMR_SLOT_1)) -
+                                                offsetof(dmr_client_t, calls));
+        dmr_call_t before = *call;
+        
+        /* Frames only move last_frame, so a call heard from since is rescheduled here */
+        if (dmr_call_expire(call, now, (uint32_t)server_config.call_timeout_ms,
+                            (uint32_t)server_config.call_hang_ms)) {
+            lost[lost_count] = before;
+            lost_addrs[lost_count++] = client->addr;
         }
+        dmr_call_arm(call);
+    }
+    dmr_rwlock_wrunlock(&clients_lock);
+    
+    /* Log outside the lock */
+    for (i = 0; i < lost_count; i++) {
+        dmr_report_lost_call(&lost_addrs[i], &lost[i], now);
     }
     
-    return -1;
+    return count;
 }
 
-/* Clean up inactive clients */
-void dmr_cleanup_clients(void) {
+/* Connected clients, read without the client lock */
+int dmr_server_client_count(void) {
+    return __atomic_load_n(&clients_published, __ATOMIC_RELAXED);
+}
+
+/* Datagrams the kernel dropped before the workers received them, by the
+ * socket filter or because a receive buffer was full */
+uint64_t dmr_server_kernel_drops(void) {
+    uint64_t drops = 0;
+#ifdef DMR_HAVE_SOCKET_FILTER
+    uint32_t meminfo[SK_MEMINFO_VARS];
+    socklen_t length;
     int i;
-    time_t now = time(NULL);
-    
-    for (i = 0; i < DMR_MAX_CLIENTS; i++) {
-        if (clients[i].active && now - clients[i].last_seen > server_config.timeout) {
-            /* Print client info if verbose */
-            if (server_config.verbose) {
-                char client_ip[INET_ADDRSTRLEN];
-                inet_ntop(AF_INET, &clients[i].addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-                
-                printf("Client timed out: %s:%d, DMR ID: %u\n",
-                       client_ip, ntohs(clients[i].addr.sin_port), clients[i].dmr_id);
-            }
-            
-            /* Log client timeout to database if enabled */
-            if (server_config.db.enabled) {
-                dmr_db_log_client(&clients[i], "timeout");
-            }
-            
-            /* Remove client */
-            clients[i].active = false;
-            client_count--;
+    
+    for (i = 0; i < worker_count; i++) {
+        length = sizeof(meminfo);
+        if (getsockopt(workers[i].socket, SOL_SOCKET, SO_MEMINFO, meminfo, &length) == 0 &&
+            length > SK_MEMINFO_DROPS * sizeof(uint32_t)) {
+            drops += meminfo[SK_MEMINFO_DROPS];
         }
     }
+#endif
+    
+    return drops;
+}
+
+/* Print one latency histogram's percentiles in microseconds */
+static void dmr_print_latency(const char *name, int stage) {
+    dmr_latency_t hist;
+    
+    dmr_latency_snapshot(stage, &hist);
+    printf("Latency %s: p50=%.1f p99=%.1f p99.9=%.1f max=%.1f us (%llu frames)\n", name,
+           dmr_latency_percentile(&hist, 50.0) / 1000.0,
+           dmr_latency_percentile(&hist, 99.0) / 1000.0,
+           dmr_latency_percentile(&hist, 99.9) / 1000.0,
+           hist.max / 1000.0, (unsigned long long)hist.count);
 }
 
 /* Print server statistics */
 void dmr_print_stats(void) {
+    dmr_db_flush_stats_t flush;
+    dmr_callsign_stats_t callsigns;
+    dmr_stats_t stats;
+    int i;
+    
+    dmr_stats_snapshot(&stats);
+    
     printf("=== DMR Server Statistics ===\n");
-    printf("Active clients: %d\n", client_count);
-    printf("Packets received: %llu\n", (unsigned long long)packets_received);
-    printf("Packets relayed: %llu\n", (unsigned long long)packets_relayed);
-    printf("Bytes received: %llu\n", (unsigned long long)bytes_received);
-    printf("Bytes sent: %llu\n", (unsigned long long)bytes_sent);
+    dmr_rwlock_rdlock(&clients_lock);
+    printf("Active clients: %d\n", dmr_clients_count());
+    dmr_rwlock_rdunlock(&clients_lock);
+    printf("Receive workers: %d (%s I/O)\n", worker_count,
+           server_config.io_backend == DMR_IO_URING ? "io_uring" : "socket");
+    if (worker_count > 1) {
+        printf("Packets by worker:");
+        for (i = 0; i < worker_count; i++) {
+            printf(" %d=%llu", i,
+                   (unsigned long long)__atomic_load_n(&dmr_stats_worker(i)->packets_received, __ATOMIC_RELAXED));
+        }
+        printf("\n");
+    }
+    printf("Packets received: %llu\n", (unsigned long long)stats.packets_received);
+    printf("Packets relayed: %llu\n", (unsigned long long)stats.packets_relayed);
+    printf("Bytes received: %llu\n", (unsigned long long)stats.bytes_received);
+    printf("Bytes sent: %llu\n", (unsigned long long)stats.bytes_sent);
+    printf("Frames by type: voice=%llu data=%llu control=%llu sync=%llu other=%llu\n",
+           (unsigned long long)stats.frames_by_type[DMR_PKT_VOICE],
+           (unsigned long long)stats.frames_by_type[DMR_PKT_DATA],
+           (unsigned long long)stats.frames_by_type[DMR_PKT_CONTROL],
+           (unsigned long long)stats.frames_by_type[DMR_PKT_SYNC],
+           (unsigned long long)stats.frames_by_type[0]);
+    printf("Frames by slot: 1=%llu 2=%llu other=%llu\n",
+           (unsigned long long)stats.frames_by_slot[DMR_SLOT_1],
+           (unsigned long long)stats.frames_by_slot[DMR_SLOT_2],
+           (unsigned long long)stats.frames_by_slot[0]);
+    printf("Errors: receive=%llu runt=%llu truncated=%llu client_limit=%llu no_route=%llu send=%llu\n",
+           (unsigned long long)stats.errors[DMR_ERR_RECV],
+           (unsigned long long)stats.errors[DMR_ERR_RUNT],
+           (unsigned long long)stats.errors[DMR_ERR_TRUNCATED],
+           (unsigned long long)stats.errors[DMR_ERR_CLIENT_LIMIT],
+           (unsigned long long)stats.errors[DMR_ERR_NO_ROUTE],
+           (unsigned long long)stats.errors[DMR_ERR_SEND]);
+    printf("Calls: %llu started, %llu ended, %llu lost, %llu conflicting frames\n",
+           (unsigned long long)stats.call_frames[DMR_CALL_START],
+           (unsigned long long)stats.call_frames[DMR_CALL_END],
+           (unsigned long long)stats.calls_lost,
+           (unsigned long long)stats.call_frames[DMR_CALL_CONFLICT]);
+    printf("Kernel drops: %llu%s\n", (unsigned long long)dmr_server_kernel_drops(),
+           server_config.kernel_filter ? " (filtered or receive buffer full)" : " (receive buffer full)");
+    dmr_print_latency("receive->process", DMR_LAT_RECV_PROCESS);
+    dmr_print_latency("process->first send", DMR_LAT_FIRST_SEND);
+    dmr_print_latency("process->last send", DMR_LAT_LAST_SEND);
+    if (server_config.db.enabled) {
+        printf("Database queue: %llu pending, %llu dropped\n",
+               (unsigned long long)dmr_db_queue_depth(),
+               (unsigned long long)dmr_db_queue_dropped());
+        dmr_db_flush_stats(&flush);
+        printf("Database frame flushes: %llu (%llu rows, max %llu rows, avg %llu us, max %llu us, %llu failed)\n",
+               (unsigned long long)flush.flushes, (unsigned long long)flush.rows,
+               (unsigned long long)flush.max_rows,
+               (unsigned long long)(flush.flushes + flush.failures ?
+                                    flush.total_usec / (flush.flushes + flush.failures) : 0),
+               (unsigned long long)flush.max_usec, (unsigned long long)flush.failures);
+        dmr_callsign_stats(&callsigns);
+        printf("Callsign cache: %u/%u entries, %llu hits, %llu negative, %llu misses, %llu evictions\n",
+               callsigns.entries, callsigns.capacity, (unsigned long long)callsigns.hits,
+               (unsigned long long)callsigns.negative_hits, (unsigned long long)callsigns.misses,
+               (unsigned long long)callsigns.evictions);
+    }
+    printf("Receive batches:");
+    for (i = 0; i < DMR_BATCH_HIST_BUCKETS; i++) {
+        int low = 1 << i;
+        int high = (i == DMR_BATCH_HIST_BUCKETS - 1) ? DMR_MAX_BATCH : (low << 1) - 1;
+        if (low == high) {
+            printf(" [%d]=%llu", low, (unsigned long long)stats.batch_hist[i]);
+        } else {
+            printf(" [%d-%d]=%llu", low, high, (unsigned long long)stats.batch_hist[i]);
+        }
+    }
+    printf("\n");
     printf("============================\n");
 }
 
 /* Clean up the DMR server */
 void dmr_server_cleanup(void) {
-    if (server_socket >= 0) {
+    int i;
+    
+    /* Stop serving metrics first, it reads the state released below */
+    dmr_metrics_stop();
+    
+    /* Close every worker socket; worker threads must already be stopped */
+    if (workers != NULL) {
+        for (i = 0; i < worker_count; i++) {
+#ifdef DMR_HAVE_URING
+            dmr_worker_close_uring(&workers[i]);
+#endif
+#ifdef DMR_HAVE_EPOLL
+            dmr_worker_close_events(&workers[i]);
+#endif
+            if (workers[i].socket >= 0) {
+                dmr_close_socket(workers[i].socket);
+            }
+        }
+        free(workers);
+        workers = NULL;
+        worker_count = 0;
 #ifdef _WIN32
-        closesocket(server_socket);
         WSACleanup();
-#else
-        close(server_socket);
 #endif
-        server_socket = -1;
     }
+#ifdef DMR_HAVE_EPOLL
+    if (stop_fd >= 0) {
+        close(stop_fd);
+        stop_fd = -1;
+    }
+#endif
+    
+    /* Release routing tables and client registry */
+    dmr_route_cleanup();
+    dmr_clients_cleanup();
     
-    /* Clean up database connection */
+    /* Drain the database writer, then close the connection */
+    dmr_db_writer_stop();
     dmr_db_cleanup();
+    dmr_callsign_cleanup();
     
     printf("DMR Voice Relay Server shut down\n");
 }
\ No newline at end of file
@@ -11,6 +11,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -31,16 +32,115 @@
 #include <fcntl.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <pthread.h>
 #endif
 
+#ifdef __linux__
+#define DMR_HAVE_MMSG           1       /* recvmmsg()/sendmmsg() available */
+#define DMR_HAVE_EPOLL          1       /* epoll, timerfd and eventfd available */
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#define DMR_HAVE_SOCKET_FILTER  1       /* Classic BPF socket filters and SO_MEMINFO available */
+#include <linux/filter.h>
+#include <linux/sock_diag.h>
+#include <linux/io_uring.h>
+#ifdef IORING_RECV_MULTISHOT
+#define DMR_HAVE_URING          1       /* io_uring with multishot receive and provided buffer rings */
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#if defined(SO_REUSEPORT) && !defined(_WIN32)
+#define DMR_HAVE_REUSEPORT      1       /* Several sockets may share one port */
+#endif
+
+#if defined(DMR_HAVE_REUSEPORT) && defined(DMR_HAVE_SOCKET_FILTER) && defined(SO_ATTACH_REUSEPORT_CBPF)
+#define DMR_HAVE_STEERING       1       /* A BPF program may pick the reuseport socket */
+#endif
+
+/* Clocks read once per receive batch; the coarse variants skip the hardware counter */
+#ifdef CLOCK_MONOTONIC_COARSE
+#define DMR_CLOCK_MONOTONIC     CLOCK_MONOTONIC_COARSE
+#define DMR_CLOCK_REALTIME      CLOCK_REALTIME_COARSE
+#else
+#define DMR_CLOCK_MONOTONIC     CLOCK_MONOTONIC
+#define DMR_CLOCK_REALTIME      CLOCK_REALTIME
+#endif
+
+/* Lock primitives shared by the worker threads */
+#ifdef _WIN32
+typedef SRWLOCK dmr_mutex_t;
+typedef SRWLOCK dmr_rwlock_t;
+#define DMR_MUTEX_INITIALIZER   SRWLOCK_INIT
+#define DMR_RWLOCK_INITIALIZER  SRWLOCK_INIT
+#define dmr_mutex_lock(m)       AcquireSRWLockExclusive(m)
+#define dmr_mutex_unlock(m)     ReleaseSRWLockExclusive(m)
+#define dmr_rwlock_rdlock(l)    AcquireSRWLockShared(l)
+#define dmr_rwlock_rdunlock(l)  ReleaseSRWLockShared(l)
+#define dmr_rwlock_wrlock(l)    AcquireSRWLockExclusive(l)
+#define dmr_rwlock_wrunlock(l)  ReleaseSRWLockExclusive(l)
+#else
+typedef pthread_mutex_t dmr_mutex_t;
+typedef pthread_rwlock_t dmr_rwlock_t;
+#define DMR_MUTEX_INITIALIZER   PTHREAD_MUTEX_INITIALIZER
+#define DMR_RWLOCK_INITIALIZER  PTHREAD_RWLOCK_INITIALIZER
+#define dmr_mutex_lock(m)       pthread_mutex_lock(m)
+#define dmr_mutex_unlock(m)     pthread_mutex_unlock(m)
+#define dmr_rwlock_rdlock(l)    pthread_rwlock_rdlock(l)
+#define dmr_rwlock_rdunlock(l)  pthread_rwlock_unlock(l)
+#define dmr_rwlock_wrlock(l)    pthread_rwlock_wrlock(l)
+#define dmr_rwlock_wrunlock(l)  pthread_rwlock_unlock(l)
+#endif
+
+/* Relaxed atomic counter update, safe from any worker thread */
+#define DMR_COUNTER_ADD(counter, value) \
+    __atomic_fetch_add(&(counter), (value), __ATOMIC_RELAXED)
+#define DMR_COUNTER_LOAD(counter) \
+    __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+/* Single-writer counter update: only the owning thread writes, readers load
+ * relaxed, so no locked instruction is needed */
+#define DMR_STATS_ADD(stats, counter, value) \
+    __atomic_store_n(&(stats)->counter, (stats)->counter + (value), __ATOMIC_RELAXED)
+
 /* DMR constants */
 #define DMR_FRAME_SIZE          33      /* Standard DMR frame size in bytes */
 #define DMR_PAYLOAD_SIZE        27      /* DMR payload size in bytes */
-#define DMR_HEADER_SIZE         6       /* DMR header size in bytes */
+#define DMR_FRAME_HEADER_SIZE   8       /* Type, slot, 24-bit source and destination IDs */
 #define DMR_SLOT_TIME_MS        60      /* DMR slot time in milliseconds */
-#define DMR_MAX_CLIENTS         100     /* Maximum number of connected clients */
+#define DMR_CALL_HANG_MS        3000    /* Default time a slot stays reserved for a call's destination after it ends */
+#define DMR_CALL_TIMEOUT_MS     1000    /* Default silence after which a call without terminator is lost */
+#define DMR_CALL_MAX_MS         3600000 /* Longest configurable call hang time or timeout */
+#define DMR_MAX_CLIENTS         65536   /* Default maximum number of connected clients */
+#define DMR_CLIENT_PAGE_SIZE    256     /* Clients allocated per registry page */
+#define DMR_MAX_SUBSCRIPTIONS   8       /* Talkgroup subscriptions per client */
+#define DMR_MAX_TALKGROUP       0xFFFFFF /* Talkgroup IDs are 24 bits on the wire */
+#define DMR_DYNAMIC_TG_TIMEOUT  900     /* Default dynamic subscription lifetime in seconds */
+#define DMR_DB_QUEUE_SIZE       8192    /* Default database writer queue length */
+#define DMR_DB_WRITER_MAX_IDLE_MS 16    /* Longest writer sleep while the queue is empty */
+#define DMR_DB_BATCH_ROWS       100     /* Default dmr_frames rows per batched INSERT */
+#define DMR_DB_FLUSH_MS         1000    /* Default longest wait before a partial batch is written */
+#define DMR_CALLSIGN_CACHE_SIZE 65536   /* Default callsign cache entries */
+#define DMR_CALLSIGN_REFRESH    300     /* Default seconds between callsign cache refreshes */
+#define DMR_CALLSIGN_NEGATIVE_TTL 600   /* Default seconds an unknown DMR ID stays cached */
 #define DMR_SERVER_PORT         62031   /* Default UDP port for DMR server */
 #define DMR_BUFFER_SIZE         1024    /* Buffer size for receiving data */
+#define DMR_MAX_BATCH           64      /* Maximum datagrams per receive batch */
+#define DMR_DEFAULT_BATCH       32      /* Default datagrams per receive batch */
+#define DMR_BATCH_HIST_BUCKETS  7       /* Batch size histogram buckets (1, 2-3, ... 64) */
+#define DMR_TX_QUEUE_SIZE       1024    /* Maximum fan-out sends per sendmmsg() flush */
+#define DMR_MAX_WORKERS         64      /* Maximum receive worker threads */
+#define DMR_EXPIRE_SLICE        64      /* Most clients expired per housekeeping pass */
+#define DMR_DRAIN_CALLS         16      /* Receive calls per socket wakeup before timers get a turn */
+#define DMR_CACHE_LINE          64      /* Alignment of data written by one thread only */
+#define DMR_URING_ENTRIES       1024    /* io_uring submission entries per worker */
+#define DMR_URING_BUFFERS       1024    /* io_uring receive buffers per worker, a power of two */
+#define DMR_URING_SENDS         4096    /* io_uring sends in flight per worker */
+#define DMR_POOL_FRAMES         DMR_URING_SENDS  /* Pooled frame buffers per worker, one per send at worst */
+#define DMR_METRICS_ADDR        "127.0.0.1"  /* Default OpenMetrics listener address */
 
 /* DMR packet types */
 #define DMR_PKT_VOICE           0x01    /* Voice packet */
@@ -52,15 +152,146 @@
 #define DMR_SLOT_1              0x01    /* DMR slot 1 */
 #define DMR_SLOT_2              0x02    /* DMR slot 2 */
 
+/* Per-slot call states */
+#define DMR_CALL_IDLE           0       /* No call, slot free */
+#define DMR_CALL_ACTIVE         1       /* Call in progress */
+#define DMR_CALL_HANG           2       /* Call ended, slot reserved for its destination */
+
+/* Frame classification by the slot's call state, counted in dmr_stats_t.call_frames */
+#define DMR_CALL_NONE           0       /* Not part of a call: no slot, sync or stray control */
+#define DMR_CALL_START          1       /* First frame of a call */
+#define DMR_CALL_CONTINUE       2       /* Frame of the slot's call */
+#define DMR_CALL_END            3       /* Terminator of the slot's call */
+#define DMR_CALL_CONFLICT       4       /* Frame of another stream while the slot is taken */
+#define DMR_CALL_CLASSES        5
+
+/* Receive and relay failures counted in dmr_stats_t.errors */
+#define DMR_ERR_RECV            0       /* recvmmsg()/recvfrom() failed */
+#define DMR_ERR_RUNT            1       /* Datagram shorter than a frame header, dropped */
+#define DMR_ERR_TRUNCATED       2       /* Datagram longer than a frame, relayed truncated */
+#define DMR_ERR_CLIENT_LIMIT    3       /* Sender not registered, client registry full */
+#define DMR_ERR_NO_ROUTE        4       /* Frame had no recipient */
+#define DMR_ERR_SEND            5       /* sendmmsg()/sendto() failed for a recipient */
+#define DMR_ERR_COUNT           6
+
+/* Statistics breakdowns; index 0 counts values outside the DMR_PKT_* and DMR_SLOT_* ranges */
+#define DMR_STATS_TYPES         5
+#define DMR_STATS_SLOTS         3
+
+/* Latency histogram stages, in nanoseconds */
+#define DMR_LAT_RECV_PROCESS    0       /* Receive call returned -> frame processing began */
+#define DMR_LAT_FIRST_SEND      1       /* Processing began -> first recipient sent */
+#define DMR_LAT_LAST_SEND       2       /* Processing began -> last recipient sent */
+#define DMR_LAT_STAGES          3
+
+/* Latency histogram geometry: each power of two is split into 2^DMR_LATENCY_SUB_BITS
+ * linear buckets (within 6.25%), values from 2^DMR_LATENCY_MAX_BITS ns (68 s) share the last */
+#define DMR_LATENCY_SUB_BITS    4
+#define DMR_LATENCY_MAX_BITS    36
+#define DMR_LATENCY_BUCKETS     ((DMR_LATENCY_MAX_BITS - DMR_LATENCY_SUB_BITS + 1) << DMR_LATENCY_SUB_BITS)
+
+/* Callsign cache lookup results */
+#define DMR_CALLSIGN_HIT        1       /* Callsign found */
+#define DMR_CALLSIGN_NEGATIVE   0       /* DMR ID known to have no callsign */
+#define DMR_CALLSIGN_MISS       -1      /* Not cached, ask the database */
+
+/* Routing modes */
+#define DMR_ROUTING_TALKGROUP   0       /* Relay to talkgroup subscribers only */
+#define DMR_ROUTING_BROADCAST   1       /* Relay every frame to every client */
+
+/* Worker selection for datagrams arriving on the shared port */
+#define DMR_STEER_HASH          0       /* Kernel reuseport hash of the 4-tuple */
+#define DMR_STEER_PEER          1       /* Source address and port, stable per repeater */
+#define DMR_STEER_SRC_ID        2       /* Frame source DMR ID, stable per voice stream */
+
+/* Socket I/O backends */
+#define DMR_IO_SOCKET           0       /* recvmmsg()/sendmmsg() system calls */
+#define DMR_IO_URING            1       /* io_uring multishot recvmsg and queued sendmsg */
+
+/* Talkgroup subscription */
+typedef struct {
+    uint32_t talkgroup;                 /* Talkgroup ID */
+    uint8_t timeslot;                   /* DMR slot */
+    bool is_static;                     /* Configured, never expires */
+    uint64_t expires;                   /* Expiry of a dynamic subscription, monotonic ms */
+} dmr_subscription_t;
+
+/* Static subscription from the configuration */
+typedef struct {
+    uint32_t dmr_id;                    /* Subscribing client's DMR ID */
+    uint32_t talkgroup;                 /* Talkgroup ID */
+    uint8_t timeslot;                   /* DMR slot, 0 for both */
+} dmr_static_sub_t;
+
+/* Timer wheel geometry: 4 levels of 64 slots cover 2^24 ticks */
+#define DMR_TIMER_BITS          6
+#define DMR_TIMER_SLOTS         (1 << DMR_TIMER_BITS)
+#define DMR_TIMER_LEVELS        4
+#define DMR_TIMER_TICK_MS       100     /* Client timeout wheel resolution */
+
+/* Timer, embedded in the object it times */
+typedef struct dmr_timer {
+    struct dmr_timer *next;             /* Slot list links, NULL when not pending */
+    struct dmr_timer *prev;
+    uint64_t expires;                   /* Tick the timer is due at */
+} dmr_timer_t;
+
+/* Hierarchical timer wheel */
+typedef struct {
+    dmr_timer_t slots[DMR_TIMER_LEVELS][DMR_TIMER_SLOTS];  /* List heads */
+    uint64_t current;                   /* Tick being drained */
+    uint32_t pending;                   /* Scheduled timers */
+} dmr_wheel_t;
+
+/* Call on one slot of one repeater */
+typedef struct {
+    uint32_t src_id;                    /* Calling DMR ID */
+    uint32_t dst_id;                    /* Called DMR ID or talkgroup */
+    uint64_t started;                   /* First frame, monotonic ms */
+    uint64_t last_frame;                /* Latest frame or terminator, monotonic ms */
+    uint8_t state;                      /* DMR_CALL_IDLE, DMR_CALL_ACTIVE or DMR_CALL_HANG */
+    uint8_t slot;                       /* DMR_SLOT_* the call is on */
+    dmr_timer_t timer;                  /* Expiry timer, pending while the call is not idle */
+} dmr_call_t;
+
 /* DMR client structure */
 typedef struct {
     struct sockaddr_in addr;            /* Client address */
-    time_t last_seen;                   /* Last time client was seen */
+    uint64_t last_seen;                 /* Last time client was seen, monotonic ms */
     uint32_t dmr_id;                    /* DMR ID of the client */
+    uint32_t slot;                      /* Registry storage slot */
+    uint32_t peer_index;                /* Position in the packed peer list */
     bool active;                         /* Is client active */
     char callsign[10];                  /* Client callsign */
+    uint8_t sub_count;                  /* Talkgroup subscriptions in use */
+    dmr_subscription_t subs[DMR_MAX_SUBSCRIPTIONS];  /* Talkgroup subscriptions */
+    dmr_timer_t timeout;                /* Inactivity timer */
+    dmr_call_t calls[2];                /* Call tracking for DMR_SLOT_1 and DMR_SLOT_2 */
+    bool call_lock;                     /* Spin lock over calls, workers may share a client */
 } dmr_client_t;
 
+/* Hash index bucket */
+typedef struct {
+    uint64_t key;                       /* Lookup key */
+    uint32_t slot;                      /* Stored value, DMR_INDEX_EMPTY if unused */
+} dmr_index_entry_t;
+
+/* Open-addressing hash index with linear probing */
+typedef struct {
+    dmr_index_entry_t *buckets;         /* Bucket array, power-of-two sized */
+    uint32_t mask;                      /* Bucket count - 1 */
+    uint32_t count;                     /* Used buckets */
+} dmr_index_t;
+
+#define DMR_INDEX_EMPTY         0xFFFFFFFFu     /* Unused index bucket */
+#define DMR_INDEX_MIN_BUCKETS   64              /* Smallest index size */
+
+/* Talkgroup subscriber */
+typedef struct {
+    struct sockaddr_in addr;            /* Subscriber address */
+    uint32_t client_slot;               /* Subscriber's registry storage slot */
+} dmr_route_member_t;
+
 /* DMR frame structure */
 typedef struct {
     uint8_t type;                       /* Packet type */
@@ -70,6 +301,58 @@ typedef struct {
     uint8_t payload[DMR_PAYLOAD_SIZE];  /* Payload data */
 } dmr_frame_t;
 
+/* Received frame, read in place; the bytes must outlive the fan-out that sends them */
+typedef struct {
+    const uint8_t *data;                /* Frame bytes */
+    int length;                         /* Bytes relayed, at most DMR_FRAME_SIZE */
+} dmr_frame_view_t;
+
+/* Point a view at a received datagram; returns -1 if it is too short to carry a header */
+static inline int dmr_frame_view_init(dmr_frame_view_t *frame, const uint8_t *buffer, int length) {
+    if (length < DMR_FRAME_HEADER_SIZE) {
+        return -1;
+    }
+    frame->data = buffer;
+    frame->length = length > DMR_FRAME_SIZE ? DMR_FRAME_SIZE : length;
+    return 0;
+}
+
+/* Frame view header accessors */
+static inline uint8_t dmr_frame_type(const dmr_frame_view_t *frame) {
+    return frame->data[0];
+}
+
+static inline uint8_t dmr_frame_slot(const dmr_frame_view_t *frame) {
+    return frame->data[1];
+}
+
+static inline uint32_t dmr_frame_src_id(const dmr_frame_view_t *frame) {
+    return ((uint32_t)frame->data[2] << 16) | ((uint32_t)frame->data[3] << 8) | frame->data[4];
+}
+
+static inline uint32_t dmr_frame_dst_id(const dmr_frame_view_t *frame) {
+    return ((uint32_t)frame->data[5] << 16) | ((uint32_t)frame->data[6] << 8) | frame->data[7];
+}
+
+/* Pooled frame buffer: a frame and its source in one cache line, shared
+ * by every send of the frame's fan-out */
+typedef struct dmr_frame_buf {
+    uint8_t data[DMR_FRAME_SIZE];       /* Frame bytes */
+    uint8_t length;                     /* Bytes used */
+    uint16_t refs;                      /* Holders: the relay and each send in flight */
+    struct sockaddr_in source;          /* Sender of the frame */
+    struct dmr_frame_buf *next;         /* Free list link */
+} __attribute__((aligned(DMR_CACHE_LINE))) dmr_frame_buf_t;
+
+/* Fixed-size frame buffer pool, used by one thread */
+typedef struct {
+    void *slab;                         /* Allocation backing every buffer */
+    dmr_frame_buf_t *buffers;           /* Buffers, cache line aligned */
+    dmr_frame_buf_t *free_list;         /* Unused buffers */
+    uint32_t capacity;
+    uint32_t free_count;
+} dmr_frame_pool_t;
+
 /* Database configuration */
 typedef struct {
     char *host;                         /* Database host */
@@ -78,27 +361,194 @@ typedef struct {
     char *database;                     /* Database name */
     uint16_t port;                      /* Database port */
     bool enabled;                       /* Database enabled flag */
+    int queue_size;                     /* Writer queue length, jobs beyond it are dropped */
+    int batch_rows;                     /* Frame rows per batched INSERT (1 disables batching) */
+    int flush_ms;                       /* Longest time a frame row waits to be written */
+    int callsign_cache;                 /* Callsign cache entries */
+    int callsign_refresh;               /* Seconds between callsign cache refreshes */
+    int callsign_negative_ttl;          /* Seconds an unknown DMR ID stays cached */
 } dmr_db_config_t;
 
+/* Frame batch flush statistics */
+typedef struct {
+    uint64_t flushes;                   /* Batched INSERTs committed */
+    uint64_t failures;                  /* Batches rolled back */
+    uint64_t rows;                      /* Rows committed */
+    uint64_t max_rows;                  /* Largest batch */
+    uint64_t total_usec;                /* Time spent flushing */
+    uint64_t max_usec;                  /* Slowest flush */
+} dmr_db_flush_stats_t;
+
+/* Callsign cache statistics */
+typedef struct {
+    uint32_t entries;                   /* Cached DMR IDs */
+    uint32_t capacity;                  /* Cache size */
+    uint64_t hits;                      /* Lookups answered with a callsign */
+    uint64_t negative_hits;             /* Lookups answered with "no callsign" */
+    uint64_t misses;                    /* Lookups passed on to the database */
+    uint64_t evictions;                 /* Entries replaced to make room */
+} dmr_callsign_stats_t;
+
+/* Packet statistics; each worker owns one block and is its only writer.
+ * Every member is a uint64_t counter so blocks can be summed field-wise. */
+typedef struct {
+    uint64_t packets_received;          /* Datagrams received */
+    uint64_t bytes_received;            /* Bytes received */
+    uint64_t packets_relayed;           /* Datagrams sent to recipients */
+    uint64_t bytes_sent;                /* Bytes sent to recipients */
+    uint64_t frames_by_type[DMR_STATS_TYPES];       /* Received frames by DMR_PKT_* */
+    uint64_t frames_by_slot[DMR_STATS_SLOTS];       /* Received frames by DMR_SLOT_* */
+    uint64_t errors[DMR_ERR_COUNT];                 /* Failures by DMR_ERR_* */
+    uint64_t call_frames[DMR_CALL_CLASSES];         /* Received frames by DMR_CALL_* */
+    uint64_t calls_lost;                            /* Calls that timed out without a terminator */
+    uint64_t batch_hist[DMR_BATCH_HIST_BUCKETS];    /* recvmmsg() batch size distribution */
+} dmr_stats_t;
+
+/* Latency histogram; per worker it has a single writer, like dmr_stats_t */
+typedef struct {
+    uint64_t count;                     /* Values recorded */
+    uint64_t sum;                       /* Sum of the values */
+    uint64_t max;                       /* Largest value */
+    uint64_t buckets[DMR_LATENCY_BUCKETS];  /* Values per log-linear bucket */
+} dmr_latency_t;
+
+#ifdef DMR_HAVE_URING
+/* io_uring instance with one provided receive buffer ring, used by one thread */
+typedef struct {
+    int fd;                             /* Ring descriptor */
+    void *ring;                         /* Shared submission and completion ring mapping */
+    size_t ring_size;
+    struct io_uring_sqe *sqes;          /* Submission entries */
+    size_t sqes_size;
+    unsigned *sq_head;                  /* Submission ring indices, head moved by the kernel */
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;             /* Entries filled, published by the next submit */
+    unsigned *cq_head;                  /* Completion ring indices, tail moved by the kernel */
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;          /* Completion entries */
+    struct io_uring_buf_ring *buf_ring; /* Free receive buffers offered to the kernel */
+    size_t buf_ring_size;
+    uint8_t *buffers;                   /* Receive buffer storage */
+    unsigned buffer_size;               /* Bytes per receive buffer */
+    unsigned buffer_count;              /* Receive buffers, a power of two */
+    uint16_t buf_tail;                  /* Buffers offered so far */
+} dmr_uring_t;
+#endif
+
 /* DMR server configuration */
 typedef struct {
     uint16_t port;                      /* Server port */
     bool verbose;                        /* Verbose output */
     char *bind_addr;                    /* Bind address */
     int timeout;                        /* Client timeout in seconds */
+    int batch_size;                     /* Datagrams drained per receive call */
+    int workers;                        /* Receive worker threads (0 = one per CPU) */
+    int max_clients;                    /* Client registry limit */
+    int routing;                        /* DMR_ROUTING_TALKGROUP or DMR_ROUTING_BROADCAST */
+    int steering;                       /* DMR_STEER_* worker selection */
+    int io_backend;                     /* DMR_IO_* socket I/O */
+    int dynamic_tg_timeout;             /* Dynamic subscription lifetime in seconds */
+    int call_hang_ms;                   /* Slot reservation after a call, milliseconds */
+    int call_timeout_ms;                /* Silence that ends a call without terminator, milliseconds */
+    dmr_static_sub_t *static_subs;      /* Static talkgroup subscriptions */
+    int static_sub_count;               /* Number of static subscriptions */
+    bool kernel_filter;                 /* Drop malformed datagrams in the kernel */
+    int metrics_port;                   /* OpenMetrics HTTP port, 0 disables */
+    char *metrics_addr;                 /* OpenMetrics listener address */
     dmr_db_config_t db;                 /* Database configuration */
 } dmr_config_t;
 
 /* Function prototypes */
 int dmr_server_init(dmr_config_t *config);
 int dmr_server_run(void);
+int dmr_server_run_worker(int worker_id);
+int dmr_server_worker_count(void);
+void dmr_server_stop(void);
 void dmr_server_cleanup(void);
-int dmr_process_frame(dmr_frame_t *frame, struct sockaddr_in *client_addr);
-int dmr_relay_frame(dmr_frame_t *frame, struct sockaddr_in *exclude_addr);
+int dmr_process_frame(const dmr_frame_view_t *frame, struct sockaddr_in *client_addr);
+int dmr_relay_frame(const dmr_frame_view_t *frame, struct sockaddr_in *exclude_addr);
+void dmr_relay_flush(void);
 int dmr_add_client(struct sockaddr_in *addr, uint32_t dmr_id, const char *callsign);
 int dmr_remove_client(struct sockaddr_in *addr);
-void dmr_cleanup_clients(void);
+int dmr_cleanup_clients(void);
+int dmr_expire_calls(void);
+void dmr_update_callsign(struct sockaddr_in *addr, uint32_t dmr_id, const char *callsign);
 void dmr_print_stats(void);
+int dmr_server_client_count(void);
+uint64_t dmr_server_kernel_drops(void);
+uint64_t dmr_clock_update(void);
+uint64_t dmr_clock_now(void);
+time_t dmr_clock_wall(void);
+
+#ifdef DMR_HAVE_URING
+/* io_uring function prototypes, each ring used by one thread */
+int dmr_uring_init(dmr_uring_t *ring, unsigned entries, unsigned buffers, unsigned buffer_size);
+void dmr_uring_cleanup(dmr_uring_t *ring);
+struct io_uring_sqe *dmr_uring_sqe(dmr_uring_t *ring);
+int dmr_uring_submit(dmr_uring_t *ring, unsigned wait);
+struct io_uring_cqe *dmr_uring_cqe(dmr_uring_t *ring);
+void dmr_uring_cqe_seen(dmr_uring_t *ring);
+uint8_t *dmr_uring_buffer(dmr_uring_t *ring, unsigned bid);
+void dmr_uring_buffer_return(dmr_uring_t *ring, unsigned bid);
+int dmr_uring_recv_multishot(dmr_uring_t *ring, int sock, struct msghdr *msg, uint64_t user_data);
+int dmr_uring_poll_multishot(dmr_uring_t *ring, int fd, uint64_t user_data);
+int dmr_uring_sendmsg(dmr_uring_t *ring, int sock, const struct msghdr *msg, uint64_t user_data);
+#endif
+
+/* Frame buffer pool function prototypes, each pool used by one thread */
+int dmr_pool_init(dmr_frame_pool_t *pool, uint32_t capacity);
+void dmr_pool_cleanup(dmr_frame_pool_t *pool);
+dmr_frame_buf_t *dmr_pool_get(dmr_frame_pool_t *pool, const dmr_frame_view_t *frame,
+                              const struct sockaddr_in *source);
+void dmr_pool_hold(dmr_frame_buf_t *buf);
+void dmr_pool_release(dmr_frame_pool_t *pool, dmr_frame_buf_t *buf);
+
+/* Hash index function prototypes */
+int dmr_index_init(dmr_index_t *index, uint32_t buckets);
+uint32_t dmr_index_find(const dmr_index_t *index, uint64_t key);
+void dmr_index_put(dmr_index_t *index, uint64_t key, uint32_t slot);
+int dmr_index_reserve(dmr_index_t *index);
+void dmr_index_remove(dmr_index_t *index, uint64_t key, uint32_t slot);
+
+/* Timer wheel function prototypes, callers serialize access */
+void dmr_wheel_init(dmr_wheel_t *wheel, uint64_t now);
+void dmr_wheel_schedule(dmr_wheel_t *wheel, dmr_timer_t *timer, uint64_t expires);
+void dmr_wheel_cancel(dmr_wheel_t *wheel, dmr_timer_t *timer);
+int dmr_wheel_advance(dmr_wheel_t *wheel, uint64_t now, dmr_timer_t **due, int max);
+
+/* Client registry function prototypes, callers hold the client lock */
+int dmr_clients_init(int max_clients);
+void dmr_clients_cleanup(void);
+dmr_client_t *dmr_clients_lookup(const struct sockaddr_in *addr);
+dmr_client_t *dmr_clients_lookup_id(uint32_t dmr_id);
+dmr_client_t *dmr_clients_insert(const struct sockaddr_in *addr);
+void dmr_clients_set_id(dmr_client_t *client, uint32_t dmr_id);
+void dmr_clients_erase(dmr_client_t *client);
+int dmr_clients_count(void);
+const struct sockaddr_in *dmr_clients_peers(int *count);
+int dmr_clients_capacity(void);
+dmr_client_t *dmr_clients_slot(uint32_t slot);
+
+/* Call tracking function prototypes, callers serialize access to the call */
+int dmr_call_classify(dmr_call_t *call, uint8_t type, uint32_t src_id, uint32_t dst_id,
+                      uint64_t now, uint32_t timeout_ms, uint32_t hang_ms, bool *lost);
+bool dmr_call_expire(dmr_call_t *call, uint64_t now, uint32_t timeout_ms, uint32_t hang_ms);
+uint64_t dmr_call_deadline(const dmr_call_t *call, uint32_t timeout_ms, uint32_t hang_ms);
+
+/* Routing function prototypes, callers hold the client lock */
+int dmr_route_init(dmr_config_t *config);
+void dmr_route_cleanup(void);
+int dmr_route_subscribe(dmr_client_t *client, uint32_t talkgroup, uint8_t timeslot,
+                        bool is_static, uint64_t expires);
+bool dmr_route_refresh(dmr_client_t *client, uint32_t talkgroup, uint8_t timeslot, uint64_t expires);
+void dmr_route_client_identified(dmr_client_t *client);
+void dmr_route_client_removed(dmr_client_t *client);
+const dmr_route_member_t *dmr_route_members(uint32_t talkgroup, uint8_t timeslot, int *count);
+int dmr_route_expire(uint64_t now);
+int dmr_route_parse_static(const char *spec, dmr_static_sub_t *sub);
 
 /* Database function prototypes */
 int dmr_db_init(dmr_db_config_t *config);
@@ -107,5 +557,40 @@ int dmr_db_log_frame(dmr_frame_t *frame, struct sockaddr_in *client_addr);
 int dmr_db_log_client(dmr_client_t *client, const char *event);
 int dmr_db_get_callsign(uint32_t dmr_id, char *callsign, size_t size);
 int dmr_db_create_tables(void);
+int dmr_db_batch_frame(dmr_frame_t *frame, struct sockaddr_in *client_addr, time_t timestamp);
+int dmr_db_flush_frames(bool force);
+void dmr_db_flush_stats(dmr_db_flush_stats_t *stats);
+int dmr_db_load_callsigns(int window);
+
+/* Database writer function prototypes, safe to call from any worker */
+int dmr_db_writer_start(dmr_db_config_t *config);
+void dmr_db_writer_stop(void);
+void dmr_db_queue_frame(const dmr_frame_view_t *frame, struct sockaddr_in *client_addr);
+void dmr_db_queue_client(dmr_client_t *client, const char *event);
+void dmr_db_queue_callsign(uint32_t dmr_id, struct sockaddr_in *client_addr);
+uint64_t dmr_db_queue_depth(void);
+uint64_t dmr_db_queue_dropped(void);
+
+/* Statistics function prototypes */
+void dmr_stats_init(int workers);
+dmr_stats_t *dmr_stats_worker(int worker_id);
+void dmr_stats_snapshot(dmr_stats_t *snapshot);
+uint64_t dmr_stats_clock(void);
+dmr_latency_t *dmr_stats_latency(int worker_id);
+void dmr_latency_record(dmr_latency_t *hist, uint64_t nsec);
+void dmr_latency_snapshot(int stage, dmr_latency_t *snapshot);
+uint64_t dmr_latency_bucket_limit(int bucket);
+uint64_t dmr_latency_percentile(const dmr_latency_t *hist, double percentile);
+
+/* OpenMetrics endpoint function prototypes */
+int dmr_metrics_start(dmr_config_t *config);
+void dmr_metrics_stop(void);
+
+/* Callsign cache function prototypes, safe to call from any thread */
+int dmr_callsign_init(int capacity, int negative_ttl);
+void dmr_callsign_cleanup(void);
+int dmr_callsign_lookup(uint32_t dmr_id, char *callsign, size_t size, uint64_t now);
+void dmr_callsign_store(uint32_t dmr_id, const char *callsign, uint64_t now);
+void dmr_callsign_stats(dmr_callsign_stats_t *stats);
 
 #endif /* DMR_SERVER_H */
\ No newline at end of file
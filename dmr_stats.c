@@ -0,0 +1,186 @@
+/*
+ * DMR Voice Relay Server - Statistics
+ * 
+ * This file contains the packet statistics. Every receive worker counts
+ * into its own block, aligned to a cache line so no two workers ever
+ * write the same line, and is the only writer of that block. Readers
+ * never take a lock: a snapshot sums the blocks field by field with
+ * relaxed loads, so it may be a few packets behind but never blocks or
+ * slows the packet path.
+ * 
+ * Latency is kept the same way, in HDR-style histograms: buckets are
+ * linear within each power of two, so recording is a couple of shifts and
+ * percentiles keep the same relative precision from nanoseconds to seconds.
+ * 
+ * Copyright (c) 2025
+ */
+
+#include "dmr_server.h"
+
+/* Counter block, padded to a whole number of cache lines */
+typedef struct {
+    dmr_stats_t stats;
+    dmr_latency_t latency[DMR_LAT_STAGES];
+} __attribute__((aligned(DMR_CACHE_LINE))) dmr_stats_block_t;
+
+/* Global variables */
+static dmr_stats_block_t blocks[DMR_MAX_WORKERS];
+static int block_count = 0;
+
+/* Reset the counters of a number of workers */
+void dmr_stats_init(int workers) {
+    if (workers < 1) {
+        workers = 1;
+    } else if (workers > DMR_MAX_WORKERS) {
+        workers = DMR_MAX_WORKERS;
+    }
+    
+    memset(blocks, 0, sizeof(blocks));
+    __atomic_store_n(&block_count, workers, __ATOMIC_RELEASE);
+}
+
+/* Counter block of a worker, to be written by that worker's thread only */
+dmr_stats_t *dmr_stats_worker(int worker_id) {
+    if (worker_id < 0 || worker_id >= DMR_MAX_WORKERS) {
+        worker_id = 0;
+    }
+    return &blocks[worker_id].stats;
+}
+
+/* Latency histograms of a worker, indexed by DMR_LAT_*, to be written by that worker only */
+dmr_latency_t *dmr_stats_latency(int worker_id) {
+    if (worker_id < 0 || worker_id >= DMR_MAX_WORKERS) {
+        worker_id = 0;
+    }
+    return blocks[worker_id].latency;
+}
+
+/* Precise monotonic clock in nanoseconds, for latency measurement */
+uint64_t dmr_stats_clock(void) {
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)(count.QuadPart * (1000000000.0 / frequency.QuadPart));
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* Bucket holding a value */
+static int dmr_latency_bucket(uint64_t value) {
+    int msb;
+    
+    if (value < (1ULL << DMR_LATENCY_SUB_BITS)) {
+        return (int)value;
+    }
+    if (value >= (1ULL << DMR_LATENCY_MAX_BITS)) {
+        return DMR_LATENCY_BUCKETS - 1;
+    }
+    
+    /* Power of two selects the group, the next DMR_LATENCY_SUB_BITS bits the bucket in it */
+    msb = 63 - __builtin_clzll(value);
+    return ((msb - DMR_LATENCY_SUB_BITS + 1) << DMR_LATENCY_SUB_BITS) +
+           (int)((value >> (msb - DMR_LATENCY_SUB_BITS)) & ((1 << DMR_LATENCY_SUB_BITS) - 1));
+}
+
+/* Largest value a bucket holds */
+uint64_t dmr_latency_bucket_limit(int bucket) {
+    int group = bucket >> DMR_LATENCY_SUB_BITS;
+    uint64_t sub = bucket & ((1 << DMR_LATENCY_SUB_BITS) - 1);
+    
+    if (group == 0) {
+        return sub;
+    }
+    if (bucket >= DMR_LATENCY_BUCKETS - 1) {
+        return UINT64_MAX;
+    }
+    return (((1ULL << DMR_LATENCY_SUB_BITS) + sub + 1) << (group - 1)) - 1;
+}
+
+/* Record a value into a histogram owned by the calling thread */
+void dmr_latency_record(dmr_latency_t *hist, uint64_t nsec) {
+    DMR_STATS_ADD(hist, buckets[dmr_latency_bucket(nsec)], 1);
+    DMR_STATS_ADD(hist, count, 1);
+    DMR_STATS_ADD(hist, sum, nsec);
+    if (nsec > hist->max) {
+        __atomic_store_n(&hist->max, nsec, __ATOMIC_RELAXED);
+    }
+}
+
+/* Merge every worker's histogram of a DMR_LAT_* stage */
+void dmr_latency_snapshot(int stage, dmr_latency_t *snapshot) {
+    int count = __atomic_load_n(&block_count, __ATOMIC_ACQUIRE);
+    int w, i;
+    
+    memset(snapshot, 0, sizeof(*snapshot));
+    if (stage < 0 || stage >= DMR_LAT_STAGES) {
+        return;
+    }
+    
+    for (w = 0; w < count; w++) {
+        dmr_latency_t *hist = &blocks[w].latency[stage];
+        uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+        
+        for (i = 0; i < DMR_LATENCY_BUCKETS; i++) {
+            snapshot->buckets[i] += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+        }
+        snapshot->count += __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+        snapshot->sum += __atomic_load_n(&hist->sum, __ATOMIC_RELAXED);
+        if (max > snapshot->max) {
+            snapshot->max = max;
+        }
+    }
+}
+
+/* Value below which a percentile (0-100) of a histogram's values fall, to bucket precision */
+uint64_t dmr_latency_percentile(const dmr_latency_t *hist, double percentile) {
+    uint64_t total = 0;
+    uint64_t rank;
+    int i;
+    
+    /* Buckets and count are loaded separately, so rank against the buckets themselves */
+    for (i = 0; i < DMR_LATENCY_BUCKETS; i++) {
+        total += hist->buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    
+    rank = (uint64_t)(percentile / 100.0 * total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    } else if (rank > total) {
+        rank = total;
+    }
+    
+    for (i = 0; i < DMR_LATENCY_BUCKETS; i++) {
+        if (hist->buckets[i] >= rank) {
+            break;
+        }
+        rank -= hist->buckets[i];
+    }
+    
+    /* The bucket's upper edge, but never beyond the largest value seen */
+    return dmr_latency_bucket_limit(i) < hist->max ? dmr_latency_bucket_limit(i) : hist->max;
+}
+
+/* Sum every worker's counters */
+void dmr_stats_snapshot(dmr_stats_t *snapshot) {
+    uint64_t *total = (uint64_t *)snapshot;
+    int count = __atomic_load_n(&block_count, __ATOMIC_ACQUIRE);
+    size_t fields = sizeof(dmr_stats_t) / sizeof(uint64_t);
+    size_t i;
+    int w;
+    
+    memset(snapshot, 0, sizeof(*snapshot));
+    for (w = 0; w < count; w++) {
+        uint64_t *counters = (uint64_t *)&blocks[w].stats;
+        
+        for (i = 0; i < fields; i++) {
+            total[i] += __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+        }
+    }
+}
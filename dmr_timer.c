@@ -0,0 +1,151 @@
+/*
+ * DMR Voice Relay Server - Timer Wheel
+ * 
+ * This file contains a hierarchical timer wheel. Timers are embedded in the
+ * objects they time and linked into one of DMR_TIMER_SLOTS slots on one of
+ * DMR_TIMER_LEVELS levels, each level covering DMR_TIMER_SLOTS times the
+ * range of the one below. Scheduling and cancelling are O(1); advancing
+ * moves the timers of a higher level slot down when the wheel reaches it
+ * and hands out due timers a bounded number at a time, so a burst of
+ * expiries is spread over several calls. The caller serializes access.
+ * 
+ * Copyright (c) 2025
+ */
+
+#include "dmr_server.h"
+
+/* Initialize an empty list */
+static void dmr_timer_list_init(dmr_timer_t *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+/* Append a timer to a list */
+static void dmr_timer_list_add(dmr_timer_t *head, dmr_timer_t *timer) {
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+/* Unlink a timer from its list */
+static void dmr_timer_list_del(dmr_timer_t *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+/* Link a timer into the slot matching its expiry */
+static void dmr_wheel_place(dmr_wheel_t *wheel, dmr_timer_t *timer) {
+    uint64_t expires = timer->expires;
+    uint64_t delta;
+    int level;
+    
+    /* Timers already due go to the slot being drained */
+    if (expires < wheel->current) {
+        expires = wheel->current;
+    }
+    
+    /* Timers beyond the wheel's range park at its far end and are placed again later */
+    delta = expires - wheel->current;
+    if (delta >= (1ULL << (DMR_TIMER_BITS * DMR_TIMER_LEVELS))) {
+        delta = (1ULL << (DMR_TIMER_BITS * DMR_TIMER_LEVELS)) - 1;
+        expires = wheel->current + delta;
+    }
+    
+    for (level = 0; level < DMR_TIMER_LEVELS - 1; level++) {
+        if (delta < (1ULL << (DMR_TIMER_BITS * (level + 1)))) {
+            break;
+        }
+    }
+    
+    dmr_timer_list_add(&wheel->slots[level][(expires >> (DMR_TIMER_BITS * level)) & (DMR_TIMER_SLOTS - 1)],
+                       timer);
+}
+
+/* Initialize a wheel starting at tick now */
+void dmr_wheel_init(dmr_wheel_t *wheel, uint64_t now) {
+    int level, slot;
+    
+    for (level = 0; level < DMR_TIMER_LEVELS; level++) {
+        for (slot = 0; slot < DMR_TIMER_SLOTS; slot++) {
+            dmr_timer_list_init(&wheel->slots[level][slot]);
+        }
+    }
+    wheel->current = now;
+    wheel->pending = 0;
+}
+
+/* Schedule a timer for a tick, moving it if it is already pending */
+void dmr_wheel_schedule(dmr_wheel_t *wheel, dmr_timer_t *timer, uint64_t expires) {
+    if (timer->next != NULL) {
+        dmr_timer_list_del(timer);
+    } else {
+        wheel->pending++;
+    }
+    
+    timer->expires = expires;
+    dmr_wheel_place(wheel, timer);
+}
+
+/* Cancel a timer if it is pending */
+void dmr_wheel_cancel(dmr_wheel_t *wheel, dmr_timer_t *timer) {
+    if (timer->next != NULL) {
+        dmr_timer_list_del(timer);
+        wheel->pending--;
+    }
+}
+
+/* Move the timers of every higher level slot that starts at the current tick down */
+static void dmr_wheel_cascade(dmr_wheel_t *wheel) {
+    int level;
+    
+    for (level = 1; level < DMR_TIMER_LEVELS; level++) {
+        dmr_timer_t *head;
+        
+        if ((wheel->current & ((1ULL << (DMR_TIMER_BITS * level)) - 1)) != 0) {
+            break;
+        }
+        
+        head = &wheel->slots[level][(wheel->current >> (DMR_TIMER_BITS * level)) & (DMR_TIMER_SLOTS - 1)];
+        while (head->next != head) {
+            dmr_timer_t *timer = head->next;
+            dmr_timer_list_del(timer);
+            dmr_wheel_place(wheel, timer);
+        }
+    }
+}
+
+/* Advance the wheel towards tick now, returning at most max due timers.
+ * A return value of max means more may be due; call again to continue. */
+int dmr_wheel_advance(dmr_wheel_t *wheel, uint64_t now, dmr_timer_t **due, int max) {
+    int count = 0;
+    
+    for (;;) {
+        dmr_timer_t *head = &wheel->slots[0][wheel->current & (DMR_TIMER_SLOTS - 1)];
+        
+        while (head->next != head && count < max) {
+            dmr_timer_t *timer = head->next;
+            dmr_timer_list_del(timer);
+            
+            /* A parked timer comes round before it is due */
+            if (timer->expires > wheel->current) {
+                dmr_wheel_place(wheel, timer);
+                continue;
+            }
+            
+            wheel->pending--;
+            due[count++] = timer;
+        }
+        
+        if (count == max || wheel->current >= now) {
+            break;
+        }
+        
+        wheel->current++;
+        dmr_wheel_cascade(wheel);
+    }
+    
+    return count;
+}
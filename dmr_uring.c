@@ -0,0 +1,256 @@
+/*
+ * DMR Voice Relay Server - io_uring
+ *
+ * This file contains a minimal io_uring wrapper for the receive workers,
+ * built on the raw system calls so no library is needed. A ring owns one
+ * provided buffer ring: the kernel picks a free buffer for each datagram a
+ * multishot recvmsg completes, and the owner hands it back once the
+ * datagram is handled. A ring is used by one thread only.
+ *
+ * Copyright (c) 2025
+ */
+
+#include "dmr_server.h"
+
+#ifdef DMR_HAVE_URING
+
+#define DMR_URING_BUFFER_GROUP  0       /* Provided buffer group of the receive buffers */
+
+/* System call wrappers */
+static int dmr_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int dmr_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int dmr_uring_register(int fd, unsigned opcode, void *arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+/* Create a ring with a number of submission entries and of receive buffers
+ * (a power of two) of buffer_size bytes each */
+int dmr_uring_init(dmr_uring_t *ring, unsigned entries, unsigned buffers, unsigned buffer_size) {
+    struct io_uring_params params;
+    struct io_uring_buf_reg reg;
+    uint8_t *sq, *cq;
+    unsigned i;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    /* Completions outnumber submissions: one multishot receive posts many */
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = entries * 4;
+    ring->fd = dmr_uring_setup(entries, &params);
+    if (ring->fd < 0) {
+        perror("Failed to set up io_uring");
+        return -1;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        fprintf(stderr, "io_uring without single mmap is not supported\n");
+        dmr_uring_cleanup(ring);
+        return -1;
+    }
+
+    /* Submission and completion rings share one mapping */
+    ring->ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    if (params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) > ring->ring_size) {
+        ring->ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    }
+    ring->ring = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        perror("Failed to map io_uring");
+        dmr_uring_cleanup(ring);
+        return -1;
+    }
+
+    sq = ring->ring;
+    cq = ring->ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    ring->sq_local_tail = *ring->sq_tail;
+
+    /* Entries map one to one onto submission slots */
+    for (i = 0; i < params.sq_entries; i++) {
+        ((unsigned *)(sq + params.sq_off.array))[i] = i;
+    }
+
+    /* Receive buffers, and the ring the kernel takes them from */
+    ring->buffer_size = buffer_size;
+    ring->buffer_count = buffers;
+    ring->buffers = mmap(NULL, (size_t)buffers * buffer_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring->buf_ring_size = buffers * sizeof(struct io_uring_buf);
+    ring->buf_ring = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buffers == MAP_FAILED || ring->buf_ring == MAP_FAILED) {
+        perror("Failed to allocate io_uring buffers");
+        dmr_uring_cleanup(ring);
+        return -1;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)ring->buf_ring;
+    reg.ring_entries = buffers;
+    reg.bgid = DMR_URING_BUFFER_GROUP;
+    if (dmr_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        perror("Failed to register io_uring buffer ring");
+        dmr_uring_cleanup(ring);
+        return -1;
+    }
+
+    for (i = 0; i < buffers; i++) {
+        dmr_uring_buffer_return(ring, i);
+    }
+
+    return 0;
+}
+
+/* Release a ring; requests still in flight are cancelled with it */
+void dmr_uring_cleanup(dmr_uring_t *ring) {
+    if (ring->fd >= 0) {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+    if (ring->ring != NULL && ring->ring != MAP_FAILED) {
+        munmap(ring->ring, ring->ring_size);
+    }
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->buf_ring != NULL && ring->buf_ring != MAP_FAILED) {
+        munmap(ring->buf_ring, ring->buf_ring_size);
+    }
+    if (ring->buffers != NULL && ring->buffers != MAP_FAILED) {
+        munmap(ring->buffers, (size_t)ring->buffer_count * ring->buffer_size);
+    }
+    ring->ring = NULL;
+    ring->sqes = NULL;
+    ring->buf_ring = NULL;
+    ring->buffers = NULL;
+}
+
+/* Next free submission entry, cleared; a full queue is submitted to make
+ * room, NULL if that fails */
+struct io_uring_sqe *dmr_uring_sqe(dmr_uring_t *ring) {
+    struct io_uring_sqe *sqe;
+
+    if (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries &&
+        (dmr_uring_submit(ring, 0) < 0 ||
+         ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)) {
+        return NULL;
+    }
+
+    sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_local_tail++;
+    return sqe;
+}
+
+/* Submit the filled entries and wait for at least wait completions;
+ * returns the number submitted, or -1 with errno set */
+int dmr_uring_submit(dmr_uring_t *ring, unsigned wait) {
+    unsigned pending;
+
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    pending = ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (pending == 0 && wait == 0) {
+        return 0;
+    }
+
+    return dmr_uring_enter(ring->fd, pending, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0);
+}
+
+/* Oldest unseen completion, NULL if there is none */
+struct io_uring_cqe *dmr_uring_cqe(dmr_uring_t *ring) {
+    unsigned head = *ring->cq_head;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+/* Hand the oldest completion's slot back to the kernel */
+void dmr_uring_cqe_seen(dmr_uring_t *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/* Start of a receive buffer */
+uint8_t *dmr_uring_buffer(dmr_uring_t *ring, unsigned bid) {
+    return ring->buffers + (size_t)bid * ring->buffer_size;
+}
+
+/* Give a receive buffer back to the kernel */
+void dmr_uring_buffer_return(dmr_uring_t *ring, unsigned bid) {
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (ring->buffer_count - 1)];
+
+    buf->addr = (uintptr_t)dmr_uring_buffer(ring, bid);
+    buf->len = ring->buffer_size;
+    buf->bid = (uint16_t)bid;
+    ring->buf_tail++;
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+/* Queue a multishot recvmsg on a socket, taking buffers from the ring's group */
+int dmr_uring_recv_multishot(dmr_uring_t *ring, int sock, struct msghdr *msg, uint64_t user_data) {
+    struct io_uring_sqe *sqe = dmr_uring_sqe(ring);
+
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = sock;
+    sqe->addr = (uintptr_t)msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = DMR_URING_BUFFER_GROUP;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/* Queue a multishot readability poll on a descriptor */
+int dmr_uring_poll_multishot(dmr_uring_t *ring, int fd, uint64_t user_data) {
+    struct io_uring_sqe *sqe = dmr_uring_sqe(ring);
+
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+/* Queue a sendmsg; the message must stay valid until its completion */
+int dmr_uring_sendmsg(dmr_uring_t *ring, int sock, const struct msghdr *msg, uint64_t user_data) {
+    struct io_uring_sqe *sqe = dmr_uring_sqe(ring);
+
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = sock;
+    sqe->addr = (uintptr_t)msg;
+    sqe->len = 1;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+#endif /* DMR_HAVE_URING */
@@ -9,6 +9,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <stdint.h>
 #include <signal.h>
 
 #ifdef _WIN32
@@ -19,22 +21,34 @@
 
 #include "dmr_server.h"
 
-/* Global variables */
-static volatile int running = 1;
-
-/* Signal handler */
+/* Signal handler, the workers return and main() joins them */
 void signal_handler(int sig) {
     printf("Received signal %d, shutting down...\n", sig);
-    running = 0;
+    dmr_server_stop();
+}
+
+/* Worker thread entry point */
+#ifdef _WIN32
+static DWORD WINAPI server_thread(LPVOID arg) {
+    dmr_server_run_worker((int)(intptr_t)arg);
+    return 0;
 }
+#else
+static void *server_thread(void *arg) {
+    dmr_server_run_worker((int)(intptr_t)arg);
+    return NULL;
+}
+#endif
 
 /* Print usage */
 void print_usage(const char *program_name) {
     printf("Usage: %s [options]\n", program_name);
     printf("Options:\n");
+    printf("  -c FILE     Configuration file (see dmr_server.conf.example)\n");
     printf("  -p PORT     Server port (default: %d)\n", DMR_SERVER_PORT);
     printf("  -b ADDR     Bind address (default: any)\n");
     printf("  -t TIMEOUT  Client timeout in seconds (default: 300)\n");
+    printf("  -w WORKERS  Receive worker threads, 0 = one per CPU (default: 1)\n");
     printf("  -v          Verbose output\n");
     printf("  -h          Print this help message\n");
     printf("\nDatabase options:\n");
@@ -44,6 +58,227 @@ void print_usage(const char *program_name) {
     printf("  --db-user   Database user (default: dmr)\n");
     printf("  --db-pass   Database password\n");
     printf("  --db-name   Database name (default: dmr_server)\n");
+    printf("  --db-queue N  Database writer queue length (default: %d)\n", DMR_DB_QUEUE_SIZE);
+    printf("  --db-batch-rows N  Frame rows per batched INSERT (default: %d, 1 disables batching)\n",
+           DMR_DB_BATCH_ROWS);
+    printf("  --db-flush-ms N    Longest wait before a partial batch is written (default: %d)\n",
+           DMR_DB_FLUSH_MS);
+    printf("  --callsign-cache N    Callsign cache entries (default: %d)\n", DMR_CALLSIGN_CACHE_SIZE);
+    printf("  --callsign-refresh N  Seconds between callsign cache refreshes, 0 disables (default: %d)\n",
+           DMR_CALLSIGN_REFRESH);
+    printf("\nPerformance options:\n");
+    printf("  --batch-size N  Datagrams per receive call (default: %d, 1 disables batching)\n",
+           DMR_DEFAULT_BATCH);
+    printf("  --max-clients N Maximum connected clients (default: %d)\n", DMR_MAX_CLIENTS);
+    printf("  --kernel-filter Drop malformed datagrams in the kernel with a socket filter (Linux)\n");
+    printf("  --io-backend MODE  socket (recvmmsg/sendmmsg) or uring (io_uring, Linux 6.0+) (default: socket)\n");
+    printf("\nMonitoring options:\n");
+    printf("  --metrics-port N    Serve OpenMetrics on http://ADDR:N/metrics, 0 disables (default: 0)\n");
+    printf("  --metrics-addr ADDR Metrics listener address (default: %s)\n", DMR_METRICS_ADDR);
+    printf("\nRouting options:\n");
+    printf("  --routing MODE  talkgroup or broadcast (default: talkgroup)\n");
+    printf("  --steering MODE Worker for each datagram: hash, peer or src_id (default: hash)\n");
+    printf("  --static-tg ID:TG[:SLOT]  Static talkgroup subscription, may be repeated\n");
+    printf("  --tg-timeout N  Dynamic subscription lifetime in seconds (default: %d)\n",
+           DMR_DYNAMIC_TG_TIMEOUT);
+    printf("  --call-hang MS  Time a slot stays reserved for a call's destination after it ends (default: %d)\n",
+           DMR_CALL_HANG_MS);
+    printf("  --call-timeout MS  Silence that ends a call without terminator (default: %d)\n",
+           DMR_CALL_TIMEOUT_MS);
+}
+
+/* Parse a worker steering mode name */
+static int parse_steering(const char *value, int *steering) {
+    if (strcmp(value, "hash") == 0) {
+        *steering = DMR_STEER_HASH;
+    } else if (strcmp(value, "peer") == 0) {
+        *steering = DMR_STEER_PEER;
+    } else if (strcmp(value, "src_id") == 0) {
+        *steering = DMR_STEER_SRC_ID;
+    } else {
+        fprintf(stderr, "Unknown steering mode: %s\n", value);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* Parse a socket I/O backend name */
+static int parse_io_backend(const char *value, int *io_backend) {
+    if (strcmp(value, "socket") == 0) {
+        *io_backend = DMR_IO_SOCKET;
+    } else if (strcmp(value, "uring") == 0) {
+        *io_backend = DMR_IO_URING;
+    } else {
+        fprintf(stderr, "Unknown I/O backend: %s\n", value);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* Parse a routing mode name */
+static int parse_routing(const char *value, int *routing) {
+    if (strcmp(value, "talkgroup") == 0) {
+        *routing = DMR_ROUTING_TALKGROUP;
+    } else if (strcmp(value, "broadcast") == 0) {
+        *routing = DMR_ROUTING_BROADCAST;
+    } else {
+        fprintf(stderr, "Unknown routing mode: %s\n", value);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* Append a static talkgroup subscription */
+static int add_static_sub(dmr_config_t *config, const char *spec) {
+    dmr_static_sub_t sub;
+    dmr_static_sub_t *grown;
+    
+    if (dmr_route_parse_static(spec, &sub) != 0) {
+        fprintf(stderr, "Invalid static talkgroup '%s', expected ID:TG[:SLOT]\n", spec);
+        return -1;
+    }
+    
+    grown = realloc(config->static_subs, (config->static_sub_count + 1) * sizeof(dmr_static_sub_t));
+    if (grown == NULL) {
+        return -1;
+    }
+    config->static_subs = grown;
+    config->static_subs[config->static_sub_count++] = sub;
+    
+    return 0;
+}
+
+/* Trim leading and trailing whitespace in place */
+static char *trim(char *str) {
+    char *end;
+    
+    while (isspace((unsigned char)*str)) {
+        str++;
+    }
+    
+    end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    *end = '\0';
+    
+    return str;
+}
+
+/* Parse a boolean configuration value */
+static bool parse_bool(const char *value) {
+    return strcmp(value, "true") == 0 || strcmp(value, "yes") == 0 ||
+           strcmp(value, "on") == 0 || strcmp(value, "1") == 0;
+}
+
+/* Load "key = value" settings from a configuration file; an invalid
+ * routing, steering, static_tg or io_backend value fails the whole file */
+static int load_config_file(const char *path, dmr_config_t *config) {
+    FILE *fp;
+    char line[256];
+    int line_no = 0;
+    int ret = 0;
+    
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+    
+    while (ret == 0 && fgets(line, sizeof(line), fp) != NULL) {
+        char *key, *value, *sep;
+        int invalid = 0;
+        
+        line_no++;
+        
+        /* Skip comments and blank lines */
+        key = trim(line);
+        if (*key == '#' || *key == '\0') {
+            continue;
+        }
+        
+        sep = strchr(key, '=');
+        if (sep == NULL) {
+            fprintf(stderr, "%s:%d: expected key = value\n", path, line_no);
+            continue;
+        }
+        *sep = '\0';
+        key = trim(key);
+        value = trim(sep + 1);
+        
+        if (strcmp(key, "port") == 0) {
+            config->port = atoi(value);
+        } else if (strcmp(key, "bind_addr") == 0) {
+            config->bind_addr = strdup(value);
+        } else if (strcmp(key, "timeout") == 0) {
+            config->timeout = atoi(value);
+        } else if (strcmp(key, "verbose") == 0) {
+            config->verbose = parse_bool(value);
+        } else if (strcmp(key, "workers") == 0) {
+            config->workers = atoi(value);
+        } else if (strcmp(key, "routing") == 0) {
+            invalid = parse_routing(value, &config->routing);
+        } else if (strcmp(key, "steering") == 0) {
+            invalid = parse_steering(value, &config->steering);
+        } else if (strcmp(key, "static_tg") == 0) {
+            invalid = add_static_sub(config, value);
+        } else if (strcmp(key, "dynamic_tg_timeout") == 0) {
+            config->dynamic_tg_timeout = atoi(value);
+        } else if (strcmp(key, "call_hang_ms") == 0) {
+            config->call_hang_ms = atoi(value);
+        } else if (strcmp(key, "call_timeout_ms") == 0) {
+            config->call_timeout_ms = atoi(value);
+        } else if (strcmp(key, "max_clients") == 0) {
+            config->max_clients = atoi(value);
+        } else if (strcmp(key, "batch_size") == 0) {
+            config->batch_size = atoi(value);
+        } else if (strcmp(key, "kernel_filter") == 0) {
+            config->kernel_filter = parse_bool(value);
+        } else if (strcmp(key, "io_backend") == 0) {
+            invalid = parse_io_backend(value, &config->io_backend);
+        } else if (strcmp(key, "metrics_port") == 0) {
+            config->metrics_port = atoi(value);
+        } else if (strcmp(key, "metrics_addr") == 0) {
+            config->metrics_addr = strdup(value);
+        } else if (strcmp(key, "db_enable") == 0) {
+            config->db.enabled = parse_bool(value);
+        } else if (strcmp(key, "db_host") == 0) {
+            config->db.host = strdup(value);
+        } else if (strcmp(key, "db_port") == 0) {
+            config->db.port = atoi(value);
+        } else if (strcmp(key, "db_user") == 0) {
+            config->db.user = strdup(value);
+        } else if (strcmp(key, "db_pass") == 0) {
+            config->db.password = strdup(value);
+        } else if (strcmp(key, "db_name") == 0) {
+            config->db.database = strdup(value);
+        } else if (strcmp(key, "db_queue") == 0) {
+            config->db.queue_size = atoi(value);
+        } else if (strcmp(key, "db_batch_rows") == 0) {
+            config->db.batch_rows = atoi(value);
+        } else if (strcmp(key, "db_flush_ms") == 0) {
+            config->db.flush_ms = atoi(value);
+        } else if (strcmp(key, "callsign_cache") == 0) {
+            config->db.callsign_cache = atoi(value);
+        } else if (strcmp(key, "callsign_refresh") == 0) {
+            config->db.callsign_refresh = atoi(value);
+        } else if (strcmp(key, "callsign_negative_ttl") == 0) {
+            config->db.callsign_negative_ttl = atoi(value);
+        } else {
+            fprintf(stderr, "%s:%d: unknown key '%s'\n", path, line_no, key);
+        }
+        
+        if (invalid != 0) {
+            fprintf(stderr, "%s:%d: invalid value for '%s'\n", path, line_no, key);
+            ret = -1;
+        }
+    }
+    
+    fclose(fp);
+    return ret;
 }
 
 /* Main function */
@@ -56,6 +291,20 @@ int main(int argc, char *argv[]) {
     config.bind_addr = NULL;
     config.verbose = false;
     config.timeout = 300; /* 5 minutes */
+    config.batch_size = DMR_DEFAULT_BATCH;
+    config.workers = 1;
+    config.max_clients = DMR_MAX_CLIENTS;
+    config.kernel_filter = false;
+    config.routing = DMR_ROUTING_TALKGROUP;
+    config.steering = DMR_STEER_HASH;
+    config.io_backend = DMR_IO_SOCKET;
+    config.dynamic_tg_timeout = DMR_DYNAMIC_TG_TIMEOUT;
+    config.call_hang_ms = DMR_CALL_HANG_MS;
+    config.call_timeout_ms = DMR_CALL_TIMEOUT_MS;
+    config.static_subs = NULL;
+    config.static_sub_count = 0;
+    config.metrics_port = 0;
+    config.metrics_addr = DMR_METRICS_ADDR;
     
     /* Set default database configuration */
     config.db.enabled = false;
@@ -64,15 +313,35 @@ int main(int argc, char *argv[]) {
     config.db.user = "dmr";
     config.db.password = NULL;
     config.db.database = "dmr_server";
+    config.db.queue_size = DMR_DB_QUEUE_SIZE;
+    config.db.batch_rows = DMR_DB_BATCH_ROWS;
+    config.db.flush_ms = DMR_DB_FLUSH_MS;
+    config.db.callsign_cache = DMR_CALLSIGN_CACHE_SIZE;
+    config.db.callsign_refresh = DMR_CALLSIGN_REFRESH;
+    config.db.callsign_negative_ttl = DMR_CALLSIGN_NEGATIVE_TTL;
+    
+    /* Load configuration file first so command line options override it */
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            if (load_config_file(argv[i + 1], &config) != 0) {
+                return 1;
+            }
+            break;
+        }
+    }
     
     /* Parse command line arguments */
     for (i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            i++; /* Already loaded */
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
             config.port = atoi(argv[++i]);
         } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
             config.bind_addr = argv[++i];
         } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
             config.timeout = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--workers") == 0) && i + 1 < argc) {
+            config.workers = atoi(argv[++i]);
         } else if (strcmp(argv[i], "-v") == 0) {
             config.verbose = true;
         } else if (strcmp(argv[i], "-h") == 0) {
@@ -90,6 +359,48 @@ int main(int argc, char *argv[]) {
             config.db.password = argv[++i];
         } else if (strcmp(argv[i], "--db-name") == 0 && i + 1 < argc) {
             config.db.database = argv[++i];
+        } else if (strcmp(argv[i], "--db-queue") == 0 && i + 1 < argc) {
+            config.db.queue_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--db-batch-rows") == 0 && i + 1 < argc) {
+            config.db.batch_rows = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--db-flush-ms") == 0 && i + 1 < argc) {
+            config.db.flush_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--callsign-cache") == 0 && i + 1 < argc) {
+            config.db.callsign_cache = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--callsign-refresh") == 0 && i + 1 < argc) {
+            config.db.callsign_refresh = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--batch-size") == 0 && i + 1 < argc) {
+            config.batch_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--kernel-filter") == 0) {
+            config.kernel_filter = true;
+        } else if (strcmp(argv[i], "--io-backend") == 0 && i + 1 < argc) {
+            if (parse_io_backend(argv[++i], &config.io_backend) != 0) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--max-clients") == 0 && i + 1 < argc) {
+            config.max_clients = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc) {
+            config.metrics_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--metrics-addr") == 0 && i + 1 < argc) {
+            config.metrics_addr = argv[++i];
+        } else if (strcmp(argv[i], "--routing") == 0 && i + 1 < argc) {
+            if (parse_routing(argv[++i], &config.routing) != 0) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--steering") == 0 && i + 1 < argc) {
+            if (parse_steering(argv[++i], &config.steering) != 0) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--static-tg") == 0 && i + 1 < argc) {
+            if (add_static_sub(&config, argv[++i]) != 0) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--tg-timeout") == 0 && i + 1 < argc) {
+            config.dynamic_tg_timeout = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--call-hang") == 0 && i + 1 < argc) {
+            config.call_hang_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--call-timeout") == 0 && i + 1 < argc) {
+            config.call_timeout_ms = atoi(argv[++i]);
         } else {
             fprintf(stderr, "Unknown option: %s\n", argv[i]);
             print_usage(argv[0]);
@@ -122,6 +433,25 @@ int main(int argc, char *argv[]) {
     }
     printf("Client timeout: %d seconds\n", config.timeout);
     printf("Verbose mode: %s\n", config.verbose ? "enabled" : "disabled");
+    printf("Receive batch size: %d\n", config.batch_size);
+    printf("Receive workers: %d", config.workers);
+    if (config.workers > 1) {
+        printf(" (steering by %s)", config.steering == DMR_STEER_PEER ? "peer" :
+               config.steering == DMR_STEER_SRC_ID ? "src_id" : "kernel hash");
+    }
+    printf("\n");
+    printf("Kernel filter: %s\n", config.kernel_filter ? "enabled" : "disabled");
+    printf("I/O backend: %s\n", config.io_backend == DMR_IO_URING ? "io_uring" : "socket");
+    printf("Routing: %s", config.routing == DMR_ROUTING_BROADCAST ? "broadcast" : "talkgroup");
+    if (config.routing == DMR_ROUTING_TALKGROUP) {
+        printf(" (%d static subscriptions, dynamic timeout %d seconds)",
+               config.static_sub_count, config.dynamic_tg_timeout);
+    }
+    printf("\n");
+    printf("Call hang time: %d ms, timeout: %d ms\n", config.call_hang_ms, config.call_timeout_ms);
+    if (config.metrics_port > 0) {
+        printf("Metrics: %s:%d\n", config.metrics_addr, config.metrics_port);
+    }
     
     /* Print database configuration if enabled */
     if (config.db.enabled) {
@@ -130,48 +460,50 @@ int main(int argc, char *argv[]) {
         printf("Database port: %d\n", config.db.port);
         printf("Database user: %s\n", config.db.user);
         printf("Database name: %s\n", config.db.database);
+        printf("Database queue: %d jobs\n", config.db.queue_size);
+        printf("Database frame batch: %d rows or %d ms\n", config.db.batch_rows, config.db.flush_ms);
+        printf("Callsign cache: %d entries, refreshed every %d seconds\n",
+               config.db.callsign_cache, config.db.callsign_refresh);
     } else {
         printf("\nDatabase logging: disabled\n");
     }
     
     printf("\nPress Ctrl+C to exit\n");
     
-    /* Run server in a separate thread */
+    /* Run each receive worker in its own thread */
+    int worker_count = dmr_server_worker_count();
 #ifdef _WIN32
-    HANDLE thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)dmr_server_run, NULL, 0, NULL);
-    if (thread == NULL) {
-        fprintf(stderr, "Failed to create server thread\n");
-        dmr_server_cleanup();
-        return 1;
-    }
+    HANDLE threads[DMR_MAX_WORKERS];
 #else
-    pthread_t thread;
-    if (pthread_create(&thread, NULL, (void *(*)(void *))dmr_server_run, NULL) != 0) {
-        fprintf(stderr, "Failed to create server thread\n");
-        dmr_server_cleanup();
-        return 1;
-    }
+    pthread_t threads[DMR_MAX_WORKERS];
 #endif
     
-    /* Wait for signal */
-    while (running) {
+    for (i = 0; i < worker_count; i++) {
 #ifdef _WIN32
-        Sleep(1000);
+        threads[i] = CreateThread(NULL, 0, server_thread, (LPVOID)(intptr_t)i, 0, NULL);
+        if (threads[i] == NULL) {
 #else
-        sleep(1);
+        if (pthread_create(&threads[i], NULL, server_thread, (void *)(intptr_t)i) != 0) {
 #endif
+            fprintf(stderr, "Failed to create server thread\n");
+            dmr_server_stop();
+            break;
+        }
     }
+    worker_count = i;
     
-    /* Clean up */
-    dmr_server_cleanup();
-    
+    /* Workers run until a signal stops them; they must be gone before their sockets are released */
+    for (i = 0; i < worker_count; i++) {
 #ifdef _WIN32
-    WaitForSingleObject(thread, INFINITE);
-    CloseHandle(thread);
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
 #else
-    pthread_cancel(thread);
-    pthread_join(thread, NULL);
+        pthread_join(threads[i], NULL);
 #endif
+    }
+    
+    /* Clean up */
+    dmr_server_cleanup();
     
     return 0;
 }
\ No newline at end of file